@@ -10,7 +10,10 @@ void CoMTrack::init_setup(double sampling_time, double single_sup_time,
   setup(sampling_time, single_sup_time, double_sup_time, cog_h);
   now_cp << com[0], com[1];
   ref_zmp << com[0], com[1];
+  step_zmp = ref_zmp;
+  ref_cp << com[0], com[1];
   ref_com << com[0], com[1], cogh;
+  b_s = exp(w * st);
 }
 
 // always can change these value
@@ -35,14 +38,127 @@ Vector3 CoMTrack::getCoMTrack(const Vector2& end_cp, double step_delta_time) {
   return ref_com;
 }
 
+// calc CoM track with analytic velocity and acceleration by LIPM
+// @param end_cp : end CP of this step
+// @param step_delta_time : dT of this step
+// @param[out] com_vel : CoM velocity w * (cp - com)
+// @param[out] com_acc : CoM acceleration w^2 * (com - zmp)
+// @return : CoM track
+Vector3 CoMTrack::getCoMTrack(const Vector2& end_cp, double step_delta_time,
+                              Vector3* com_vel, Vector3* com_acc) {
+  ref_cp = calcCPTrack(step_delta_time);
+  calcCoMTrack(ref_cp);
+  Vector2 com_pos(ref_com[0], ref_com[1]);
+  Vector2 vel = w_s * (ref_cp - com_pos);
+  Vector2 acc = w_s * w_s * (com_pos - ref_zmp);
+  *com_vel << vel[0], vel[1], 0.0;
+  *com_acc << acc[0], acc[1], 0.0;
+  return ref_com;
+}
+
 // call only changed swing leg
 // @param end_cp : end CP of this step
 // @return : reference ZMP point of this step
+// CP at the end of the step before is given by the constants of that step,
+// so step time and CoM height can change step by step.
 void CoMTrack::calcRefZMP(const Vector2& end_cp) {
+  now_cp = ref_zmp + b_s * (now_cp - ref_zmp);
   setStepVariable();
-  double b = exp(w * st_s);
-  now_cp = calcCPTrack(st_s);
-  ref_zmp = (end_cp - b * now_cp) / (1 - b);
+  b_s = exp(w * st_s);
+  ref_zmp = (end_cp - b_s * now_cp) / (1 - b_s);
+  step_zmp = ref_zmp;
+}
+
+// call only changed swing leg
+// @param end_cp : end CP of this step
+// @param sp : precomputed constants of this step
+void CoMTrack::calcRefZMP(const Vector2& end_cp, const StepParam& sp) {
+  now_cp = ref_zmp + b_s * (now_cp - ref_zmp);
+  st_s = sp.st;
+  dt_s = sp.dt;
+  w_s = sp.w;
+  b_s = sp.b;
+  ref_zmp = (end_cp - sp.b * now_cp) / (1 - sp.b);
+  step_zmp = ref_zmp;
+}
+
+// @brief solve landing position, remaining step time and reference ZMP of
+// this step so that CP at the end of step is the nominal offset from the
+// landing position. With ZMP fixed at zmp for the rest of the step,
+// end CP = zmp + s * (cp - zmp), s = exp(w * tau). ZMP moves from the
+// nominal of the step within the stance foot, which handles small error
+// (it works (s - 1) times as much as the landing position).
+// Box constrained QP of (land, s, zmp) is solved by coordinate descent,
+// which needs no allocation and has fixed calculation time. Boxes of land
+// and zmp are in the frame of rot, where the objective is the same.
+//   min  weight_land * |land - land_nom|^2 + weight_time * (s - s_nom)^2
+//      + weight_zmp * |zmp - zmp_nom|^2
+//      + weight_offset * |zmp + s * (cp - zmp) - land - offset_nom|^2
+// @param cp : measured capture point
+// @param land_nom, end_cp_nom, tau_nom : nominal values of this step
+// @param rot : frame of the boxes (walking direction)
+// @param land_lo, land_hi : range of landing position from nominal in rot
+// @param tau_min, tau_max : limits of remaining step time
+// @param sa : limits and weights
+// @param[out] land : landing position
+// @param[out] zmp : reference ZMP
+// @param[out] tau : remaining step time
+// @return : error of end CP offset from nominal [m]
+double CoMTrack::solveStepAdapt(const Vector2& cp, const Vector2& land_nom,
+                                const Vector2& end_cp_nom, const Matrix2& rot,
+                                const Vector2& land_lo, const Vector2& land_hi,
+                                double tau_nom, double tau_min, double tau_max,
+                                const StepAdaptParam& sa,
+                                Vector2* land, Vector2* zmp, double* tau) {
+  const Vector2 offset_nom = end_cp_nom - land_nom;
+  const Vector2 zmp_lim(sa.zmp_range, sa.zmp_range);
+  const double s_nom = exp(w_s * tau_nom);
+  const double s_min = exp(w_s * tau_min);
+  const double s_max = exp(w_s * tau_max);
+  const double wl = sa.weight_land, wt = sa.weight_time, wo = sa.weight_offset;
+  const double wz = sa.weight_zmp;
+
+  double s = std::min(std::max(s_nom, s_min), s_max);
+  Vector2 u = land_nom, z = step_zmp;
+  for (int i = 0; i < sa.iteration; ++i) {
+    Vector2 d = cp - z;
+    Vector2 u_free = (wl * land_nom + wo * (z + s * d - offset_nom)) / (wl + wo);
+    u = land_nom + rot * (rot.transpose() * (u_free - land_nom))
+                             .cwiseMax(land_lo).cwiseMin(land_hi);
+    double s_free = (wt * s_nom - wo * d.dot(z - u - offset_nom)) /
+                    (wt + wo * d.squaredNorm());
+    s = std::min(std::max(s_free, s_min), s_max);
+    // end CP = zmp_nom + s * (cp - zmp_nom) - (s - 1) * (zmp - zmp_nom)
+    double c = s - 1.0, den = wz + wo * c * c;
+    Vector2 r = step_zmp + s * (cp - step_zmp) - u - offset_nom;
+    Vector2 z_free = den > 0.0 ? Vector2(wo * c * r / den) : Vector2::Zero();
+    z = step_zmp + rot * (rot.transpose() * z_free)
+                             .cwiseMax(-zmp_lim).cwiseMin(zmp_lim);
+  }
+  *land = u;
+  *zmp = z;
+  *tau = log(s) / w_s;
+  return (z + s * (cp - z) - u - offset_nom).norm();
+}
+
+// @brief true if ZMP feedback within margin from ref_zmp brings measured CP
+// back to the track by the end of step, |cp - ref_cp| * s <= (s - 1) * margin
+// @param tau : remaining step time, s = exp(w * tau)
+bool CoMTrack::isCPInMargin(const Vector2& cp, double step_delta_time,
+                            double tau, double margin) {
+  double s = exp(w_s * tau);
+  return (cp - calcCPTrack(step_delta_time)).norm() * s <= (s - 1.0) * margin;
+}
+
+// @brief move CP track of this step to pass measured CP at step_delta_time
+// with reference ZMP zmp, and end at the adapted step time
+// @param step_time: time of this step, CP at the end of step is given by it
+void CoMTrack::resetCP(const Vector2& cp, const Vector2& zmp,
+                       double step_delta_time, double step_time) {
+  ref_zmp = zmp;
+  now_cp = ref_zmp + exp(-w_s * step_delta_time) * (cp - ref_zmp);
+  st_s = step_time;
+  b_s = exp(w_s * st_s);
 }
 
 void CoMTrack::setStepVariable() {
@@ -3,11 +3,27 @@
 
 #include <iostream>
 #include <cmath>
+#include <algorithm>
 
 #include "eigen_types.h"
+#include "step_param.h"
 
 namespace cp {
 
+// limits and weights of step adaptation by measured capture point
+struct StepAdaptParam {
+  double sst_min, sst_max;  // single support time [s]
+  double min_swing_time;    // min remaining time of swing leg [s]
+  double land_dx, land_dy;  // landing position range from nominal [m]
+  double weight_land;       // weight of landing position from nominal
+  double weight_time;       // weight of exp(w * remaining time) from nominal
+  double weight_offset;     // weight of end CP offset from nominal
+  int iteration;            // iteration of the solver
+  double zmp_range;         // reference ZMP range from nominal [m]
+  double weight_zmp;        // weight of reference ZMP from nominal
+  double cp_margin;         // CP error left to ZMP feedback of the robot [m]
+};
+
 // Calc CoM track class.
 // It used by cpgen class only.
 class CoMTrack {
@@ -23,8 +39,23 @@ class CoMTrack {
              double double_sup_time, double cog_h);
 
   Vector3 getCoMTrack(const Vector2& end_cp, double step_delta_time);
+  Vector3 getCoMTrack(const Vector2& end_cp, double step_delta_time,
+                      Vector3* com_vel, Vector3* com_acc);
   void calcRefZMP(const Vector2& end_cp);
+  void calcRefZMP(const Vector2& end_cp, const StepParam& sp);
   Vector2 getRefZMP() {return ref_zmp;}
+  Vector2 getRefCP() {return ref_cp;}
+
+  double solveStepAdapt(const Vector2& cp, const Vector2& land_nom,
+                        const Vector2& end_cp_nom, const Matrix2& rot,
+                        const Vector2& land_lo, const Vector2& land_hi,
+                        double tau_nom, double tau_min, double tau_max,
+                        const StepAdaptParam& sa,
+                        Vector2* land, Vector2* zmp, double* tau);
+  bool isCPInMargin(const Vector2& cp, double step_delta_time, double tau,
+                    double margin);
+  void resetCP(const Vector2& cp, const Vector2& zmp, double step_delta_time,
+               double step_time);
 
  private:
   void setStepVariable();
@@ -42,10 +73,13 @@ class CoMTrack {
   double st_s;
   double dt_s;
   double w_s;
+  double b_s;  // exp(w_s * st_s)
 
   Vector3 ref_com;
   Vector2 now_cp;
   Vector2 ref_zmp;
+  Vector2 step_zmp;  // ref_zmp at the start of this step
+  Vector2 ref_cp;
 };
 }  // namespace cp
 
@@ -19,21 +19,52 @@ void cpgen::initialize(const Vector3& com, const Affine3d& init_waist_pose,
   // pf.init_setup(init_leg_pose, waist_r, com, endcpoff);
   this->init_waist_pose.set(init_waist_pose.translation(),
                             init_waist_pose.rotation());
+  // CoM of the pattern is at cogh, not at the height of com
+  com2waist = this->init_waist_pose.q().conjugate() *
+              (this->init_waist_pose.p() - Vector3(com.x(), com.y(), cog_h));
   land_pos = Vector3::Zero();
+  bfr_land_pos = Vector3::Zero();
+  // capacity set by setStepCache is kept
+  stepcache.clear();
   this->end_cp_offset[0] = end_cp_offset[0];
   this->end_cp_offset[1] = end_cp_offset[1];
 
   wstate = stopped;
+  estop_state = stopped;
 
   for (int i = 0; i < 2; ++i) {
     Vector3 trans = init_leg_pose[i].translation();
     Quat q(init_leg_pose[i].rotation());
     init_feet_pose[i].set(trans, q);
     // ref_land_pose[i].set(init_feet_pose[i]);
-    dist_body2foot[i] << trans;  // TODO! subtraction to body position
+    // foot from waist on the ground, in waist coordinate
+    dist_body2foot[i] << trans;
     dist_body2foot[i].x() -= this->init_waist_pose.p().x();
+    dist_body2foot[i].y() -= this->init_waist_pose.p().y();
+    dist_body2foot[i] = this->init_waist_pose.q().conjugate() *
+                        dist_body2foot[i];
+    waist2foot[i] = this->init_waist_pose.q().conjugate() * q;
   }
 
+  step_delta_time = double_sup_time + single_sup_time + 1.0;
+  end_cp << this->init_waist_pose.p().x(), this->init_waist_pose.p().y();
+  ref_waist_pose.set(this->init_waist_pose);
+  ref_land_pose[0].set(init_feet_pose[0]);
+  ref_land_pose[1].set(init_feet_pose[1]);
+  adapt_enable = false;
+  cp_measured = false;
+  adapting = false;
+  adapt_error = 0.0;
+  scheduled = false;
+  step_queue.clear();
+  base_h = (init_feet_pose[0].p().z() + init_feet_pose[1].p().z()) * 0.5;
+  base_cogh = cog_h;
+  com_z_t0 = 0.0;
+  com_z_T = single_sup_time + double_sup_time;
+  inter_com_z.setInter5(0.0, 0.0, 0.0, 0.0, 0.0, 0.0, com_z_T);
+  // leg geometry may be set before initialize
+  if (legik.isEnabled()) setLegGeometry(legik.getGeometry());
+
   std::cout << "[cpgen] initialize finish" << std::endl;
 }
 
@@ -42,7 +73,8 @@ void cpgen::initialize(const Vector3& com, const Affine3d& init_waist_pose,
 // @param sst: single support time
 // @param dst: double support time
 // @param cogh: height center of gravity
-// @param legh: height of up leg
+// @param legh: height of up leg above the highest of lift off height,
+// landing height and terrain under swing leg
 void cpgen::setup(double t, double sst, double dst, double cogh, double legh) {
   dt = t;
   single_sup_time = sst;
@@ -56,7 +88,9 @@ void cpgen::setup(double t, double sst, double dst, double cogh, double legh) {
 
 void cpgen::start() {
   if (wstate == stopped) {
-    wstate = starting1;
+    // a new start from the middle of a step makes the feet jump
+    wstate = estop_state == stopped ? starting1 : estop_state;
+    estop_state = stopped;
     std::cout << "[cpgen] Start Walking" << std::endl;
   }
 }
@@ -68,48 +102,400 @@ void cpgen::stop() {
   }
 }
 
+// @brief freeze the pattern. initialize drops the frozen state.
 void cpgen::estop() {
+  if (wstate != stopped) estop_state = wstate;
   wstate = stopped;
+  step_queue.clear();
   std::cout << "[cpgen] Emergency Stop" << std::endl;
 }
 
+// @brief swing leg of the next step which uses setLandPos or pushStep.
+// the first step of a walk (starting1) does not move legs, so a walk
+// starts by the other leg.
+// @return: swing leg of the first footstep of a plan (PlanPath::plan)
+rl cpgen::getNextSwingleg() {
+  walking_state ws = wstate;
+  if (ws == stopped) ws = estop_state == stopped ? starting1 : estop_state;
+  // the step in progress has already used its command
+  bool boundary = step_delta_time >= getStepTime();
+  rl next = boundary ? swingleg : (swingleg == right ? left : right);
+  if (boundary && ws == starting1) next = next == right ? left : right;
+  return next;
+}
+
 void cpgen::setLandPos(const Vector3& pose) {
   land_pos = pose;  // TODO! Round down to about millimeter
   land_pos.z() = deg2rad(land_pos.z());
 }
 
+// @param pos: landing position, same as setLandPos
+// @param sched: timing and height of the step
+void cpgen::pushStep(const Vector3& pos, const StepSchedule& sched) {
+  QueuedStep s;
+  s.land_pos << pos.x(), pos.y(), deg2rad(pos.z());
+  // swing leg height is planned for flat ground, and planned again at
+  // the step only if the terrain is different.
+  double ground_h = legtrack.getGroundHeight();
+  s.param.set(dt, sched.sst, sched.dst, sched.cogh, sched.legh,
+              ground_h, ground_h, ground_h);
+  step_queue.push_back(s);
+}
+
 void cpgen::getWalkingPattern(Vector3* com_pos, Quat* waist_r,
                               Pose* right_leg_pose, Pose* left_leg_pose) {
-
-  static double step_delta_time = double_sup_time + single_sup_time + 1.0;
-  static Vector2 end_cp(init_waist_pose.p().x(), init_waist_pose.p().y());
-  static Pose ref_waist_pose = init_waist_pose;
-  static Pose ref_land_pose[2] = {init_feet_pose[0], init_feet_pose[1]};
-
   if (wstate == stopped) return;
 
   // if finished a step, calc leg track and reference ZMP.
-  if (step_delta_time >= double_sup_time + single_sup_time) {
-    // to calc legtrack
-    calcNextFootprint(land_pos, land_pos.z(),
-                      ref_waist_pose, ref_land_pose);
-    end_cp = calcEndCP(ref_land_pose);
-    comtrack.calcRefZMP(end_cp);
-    legtrack.setStepVar(ref_land_pose, ref_waist_pose.q(), swingleg, wstate);
-    step_delta_time = 0.0;
-  }
+  updateStep();
+  adaptStep();
 
   // push walking pattern
-  static Pose leg_pose[2];
   *com_pos = comtrack.getCoMTrack(end_cp, step_delta_time);
+  addCoMHeight(com_pos, NULL, NULL);
   legtrack.getLegTrack(step_delta_time, leg_pose);
   *waist_r = legtrack.getWaistTrack(step_delta_time);
   *right_leg_pose = leg_pose[0];
   *left_leg_pose  = leg_pose[1];
 
   // setting flag and time if finished a step
+  updateWstate();
+}
+
+// @brief get walking pattern with analytic velocity and acceleration
+// @param[out] wp: positions, velocities and accelerations of this cycle
+void cpgen::getWalkingPattern(WalkingPattern* wp) {
+  if (wstate == stopped) return;
+
+  updateStep();
+  adaptStep();
+
+  wp->com_pos = comtrack.getCoMTrack(end_cp, step_delta_time,
+                                     &wp->com_vel, &wp->com_acc);
+  addCoMHeight(&wp->com_pos, &wp->com_vel, &wp->com_acc);
+  legtrack.getLegTrack(step_delta_time, wp->leg_pose,
+                       wp->leg_vel, wp->leg_acc);
+  wp->waist_r = legtrack.getWaistTrack(step_delta_time);
+  wp->waist_w = legtrack.getWaistAngVel(step_delta_time);
+  wp->ref_zmp = comtrack.getRefZMP();
+  wp->ref_cp = comtrack.getRefCP();
+  wp->support = legtrack.getSupportLeg();
+
+  updateWstate();
+}
+
+// @brief get walking pattern and joint angles of legs by LegIK
+// @param[out] wp: positions, velocities and accelerations of this cycle
+// @param[out] leg_q[right, left]: joint angles [rad]
+// @return: false if IK is not set up or a leg is out of reach
+bool cpgen::getWalkingPattern(WalkingPattern* wp, Vector6 leg_q[]) {
+  if (wstate == stopped) return false;
+  getWalkingPattern(wp);
+  // no message, this is called every control cycle
+  if (!legik.isEnabled()) return false;
+  return legik.calcJoint(wp->com_pos, wp->waist_r, wp->leg_pose, leg_q);
+}
+
+// @brief set leg geometry of inverse kinematics stage.
+// It can be called before or after initialize, offsets are updated by it.
+// @param geo: leg geometry. hip (x, y) offset is taken from initial leg pose
+void cpgen::setLegGeometry(const LegGeometry& geo) {
+  legik.setup(geo, dist_body2foot, com2waist);
+}
+
+// @brief calc leg track and reference ZMP if finished a step
+void cpgen::updateStep() {
+  if (step_delta_time >= getStepTime()) {
+    popStep();
+    // to calc legtrack
+    Pose lift_pose = ref_land_pose[swingleg];
+    // command is not used in the first and the last two steps. legs do not
+    // move in starting1 and stopping2, and stopping1 puts the feet together.
+    // otherwise the feet jump at the next start.
+    bool no_cmd = wstate == starting1 || wstate == stopping1 ||
+                  wstate == stopping2;
+    Vector3 step = no_cmd ? Vector3::Zero() :
+                   (scheduled ? sched_land_pos : land_pos);
+    calcNextFootprint(step, step.z(), ref_waist_pose, ref_land_pose);
+    calcTerrain(lift_pose);
+    end_cp = calcEndCP(ref_land_pose);
+    setStepVar(step);
+    land_nom << ref_land_pose[swingleg].p().x(), ref_land_pose[swingleg].p().y();
+    end_cp_nom = end_cp;
+    st_nom = legtrack.getStepTime();
+    adapting = false;
+    bfr_land_pos = step;
+    planCoMHeight(step_delta_time, 0.0);
+    step_delta_time = 0.0;
+  }
+}
+
+// @brief use the next queued step in the steps driven by commands.
+// land_pos is kept, it is used again after the queue is empty.
+void cpgen::popStep() {
+  scheduled = false;
+  if (step_queue.empty() || wstate == starting1 || wstate == stopping1 ||
+      wstate == stopping2) return;
+  sched_land_pos = step_queue.front().land_pos;
+  sched_param = step_queue.front().param;
+  // sampling time of now, not of pushStep
+  sched_param.dt = dt;
+  step_queue.pop_front();
+  scheduled = true;
+}
+
+// @brief landing height and highest terrain under swing leg of this step
+// @param lift_pose: pose of swing leg at lift off
+void cpgen::calcTerrain(const Pose& lift_pose) {
+  const Vector3& lift_pos = lift_pose.p();
+  lift_h = lift_pos.z();
+  lift_yaw = q2yaw(lift_pose.q());
+  obstacle_h = lift_h;
+  Vector3& land = ref_land_pose[swingleg].p();
+  // legs do not move in these steps. the feet are not side by side after
+  // an adapted step, so the footprint from the waist is not used
+  if (wstate == starting1 || wstate == stopping2) {
+    land = lift_pos;
+    return;
+  }
+  if (!heightmap) return;
+
+  double h;
+  if (heightmap->getHeight(land.x(), land.y(), &h)) land.z() = h;
+  Vector3 lift(lift_pos.x(), lift_pos.y(), lift_yaw);
+  Vector3 end(land.x(), land.y(), q2yaw(ref_land_pose[swingleg].q()));
+  if (getSweptHeight(lift, end, &h)) obstacle_h = h;
+}
+
+// @brief highest terrain under the sole of swing leg swept between two poses
+// @param lift, land: leg end link x[m], y[m], yaw[rad]
+// @return false if the sweep is out of the map
+bool cpgen::getSweptHeight(const Vector3& lift, const Vector3& land,
+                           double* h) {
+  Vector2 lo(-sole.back, swingleg == right ? -sole.outer : -sole.inner);
+  Vector2 hi(sole.front, swingleg == right ? sole.inner : sole.outer);
+  return heightmap->getMaxHeight(lift, land, lo, hi, h);
+}
+
+// @brief plan CoM height offset to the mean height of feet at the end of
+// this step, from the present offset, velocity and acceleration.
+// A scheduled step also goes to its own cogh (from the feet). The waist
+// keeps com2waist from CoM, so IK bends the legs for it.
+// @param t_now: present time of the plan before
+// @param t: present time of this step
+void cpgen::planCoMHeight(double t_now, double t) {
+  double z, dz, ddz;
+  calcCoMHeight(t_now, &z, &dz, &ddz);
+  double h = (ref_land_pose[right].p().z() + ref_land_pose[left].p().z()) * 0.5;
+  if (scheduled) h += sched_param.cogh - base_cogh;
+  com_z_t0 = t;
+  com_z_T = std::max(getStepTime() - t, dt);
+  inter_com_z.setInter5(z, dz, ddz, h - base_h, 0.0, 0.0, com_z_T);
+}
+
+// @brief CoM height offset by terrain (and scheduled cogh) at time t of
+// the step
+void cpgen::calcCoMHeight(double t, double* z, double* dz, double* ddz) {
+  double tz = t - com_z_t0;
+  if (tz >= com_z_T) {
+    *z = inter_com_z.inter5(com_z_T);
+    *dz = *ddz = 0.0;
+  } else {
+    *z = inter_com_z.inter5(tz);
+    *dz = inter_com_z.dinter5(tz);
+    *ddz = inter_com_z.ddinter5(tz);
+  }
+}
+
+// @brief add CoM height offset by terrain (and scheduled cogh) to CoM track
+// of this cycle
+// @param[in, out] com_vel, com_acc: NULL if not used
+void cpgen::addCoMHeight(Vector3* com_pos, Vector3* com_vel,
+                         Vector3* com_acc) {
+  double z, dz, ddz;
+  calcCoMHeight(step_delta_time, &z, &dz, &ddz);
+  com_pos->z() += z;
+  if (com_vel) com_vel->z() += dz;
+  if (com_acc) com_acc->z() += ddz;
+}
+
+// @param sa: limits and weights of step adaptation
+// @param enable: use step adaptation
+void cpgen::setStepAdaptation(const StepAdaptParam& sa, bool enable) {
+  adapt_param = sa;
+  adapt_enable = enable;
+}
+
+// @param cp: measured capture point (world coordinate)
+void cpgen::setMeasuredCP(const Vector2& cp) {
+  measured_cp = cp;
+  cp_measured = true;
+}
+
+// @brief adapt single support time and landing position of this step
+// by measured CP. While ZMP feedback of the robot can bring measured CP
+// back, the track of the step is kept as it is. Once adapted, CP track and
+// swing leg track continue from measured CP until the end of the step.
+void cpgen::adaptStep() {
+  if (!adapt_enable || !cp_measured) return;
+  cp_measured = false;
+  if (wstate == starting1 || wstate == stopping2) return;
+  double dst_s = legtrack.getDoubleSupTime();
+  double sst_s = legtrack.getSingleSupTime();
+  double sst_time = step_delta_time - dst_s*0.5;
+  // swing leg is landing, too late to change
+  if (sst_s - sst_time < adapt_param.min_swing_time) return;
+
+  // nominal and limits of remaining step time
+  double tau_nom = st_nom - step_delta_time;
+  double sst_lo = std::max(adapt_param.sst_min,
+                           std::max(sst_time, 0.0) + adapt_param.min_swing_time);
+  double sst_hi = std::max(adapt_param.sst_max, sst_lo);
+  double tau_min = dst_s + sst_lo - step_delta_time;
+  double tau_max = dst_s + sst_hi - step_delta_time;
+  if (!adapting && comtrack.isCPInMargin(measured_cp, step_delta_time,
+                                         tau_nom, adapt_param.cp_margin)) {
+    adapt_error = 0.0;
+    return;
+  }
+  adapting = true;
+
+  // landing range in the walking direction. swing leg does not go over
+  // half the nominal step width inward, or the legs cross
+  Matrix2 rot = ref_waist_pose.q().toRotationMatrix().topLeftCorner<2, 2>();
+  const Pose& stance_pose = ref_land_pose[swingleg == right ? left : right];
+  Vector2 stance(stance_pose.p().x(), stance_pose.p().y());
+  double inner = std::min(adapt_param.land_dy,
+      0.5 * std::abs((rot.transpose() * (land_nom - stance)).y()));
+  Vector2 land_lo(-adapt_param.land_dx, -adapt_param.land_dy);
+  Vector2 land_hi(adapt_param.land_dx, adapt_param.land_dy);
+  if (swingleg == left) land_lo.y() = -inner;
+  else land_hi.y() = inner;
+
+  Vector2 land, zmp;
+  double tau;
+  adapt_error = comtrack.solveStepAdapt(measured_cp, land_nom, end_cp_nom,
+                                        rot, land_lo, land_hi,
+                                        tau_nom, tau_min, tau_max,
+                                        adapt_param, &land, &zmp, &tau);
+
+  // swing leg track is kept if the solution is the same
+  double sst_new = tau + step_delta_time - dst_s;
+  Vector2 shift = land - Vector2(ref_land_pose[swingleg].p().x(),
+                                 ref_land_pose[swingleg].p().y());
+  bool same = shift.norm() < 1e-6 && std::abs(sst_new - sst_s) < 1e-6;
+  double land_h = ref_land_pose[swingleg].p().z();
+  if (!same) {
+    // the rest of swing goes over other terrain, which is added to the
+    // obstacle of this step (the leg may already be above the old one)
+    if (heightmap) {
+      heightmap->getHeight(land.x(), land.y(), &land_h);
+      Vector3 now = legtrack.getSwingPos(step_delta_time);
+      double yaw = q2yaw(ref_land_pose[swingleg].q()), h;
+      if (getSweptHeight(Vector3(now.x(), now.y(), lift_yaw),
+                         Vector3(land.x(), land.y(), yaw), &h))
+        obstacle_h = std::max(obstacle_h, h);
+    }
+    legtrack.adaptStep(step_delta_time, land, land_h, obstacle_h, sst_new);
+  }
+  // CP track ends with the step, which CoMTrack does not know otherwise
+  comtrack.resetCP(measured_cp, zmp, step_delta_time, legtrack.getStepTime());
+  if (same) return;
+
+  // following footprints are planned from the adapted landing position
+  ref_land_pose[swingleg].p().x() += shift.x();
+  ref_land_pose[swingleg].p().y() += shift.y();
+  ref_land_pose[swingleg].p().z() = land_h;
+  ref_waist_pose.p().x() += shift.x();
+  ref_waist_pose.p().y() += shift.y();
+  planCoMHeight(step_delta_time, step_delta_time);
+}
+
+// @brief set reference ZMP and leg track variables of a step.
+// In walking, the constants of a step are reused from step cache.
+// setLegacyStep calculates them here in all states (no StepParam).
+// Scheduled steps use the constants calculated by pushStep.
+// Only walk and step are cached: in the other states the legs start from
+// the initial pose or are put together, which the key does not have.
+// @param cmd: command of this step
+void cpgen::setStepVar(const Vector3& cmd) {
+  if (legacy_step) {
+    // a scheduled step is given to the tracks as setup of this step only
+    if (scheduled) {
+      comtrack.setup(sched_param.dt, sched_param.sst, sched_param.dst,
+                     sched_param.cogh);
+      legtrack.setup(sched_param.dt, sched_param.sst, sched_param.dst,
+                     sched_param.legh);
+    }
+    comtrack.calcRefZMP(end_cp);
+    legtrack.setStepVar(ref_land_pose, ref_waist_pose.q(), swingleg, wstate,
+                        obstacle_h);
+    if (scheduled) {
+      comtrack.setup(dt, single_sup_time, double_sup_time, cog_h);
+      legtrack.setup(dt, single_sup_time, double_sup_time, leg_h);
+    }
+    return;
+  }
+  if (wstate != walk && wstate != step) {
+    if (scheduled) {
+      StepParam sp = sched_param;
+      sp.setSwing(lift_h, ref_land_pose[swingleg].p().z(), obstacle_h);
+      comtrack.calcRefZMP(end_cp, sp);
+      legtrack.setStepVar(ref_land_pose, ref_waist_pose.q(), swingleg, wstate,
+                          sp, NULL);
+    } else {
+      comtrack.calcRefZMP(end_cp);
+      legtrack.setStepVar(ref_land_pose, ref_waist_pose.q(), swingleg, wstate,
+                          obstacle_h);
+    }
+    return;
+  }
+
+  StepKey key;
+  key.land_pos = cmd;
+  key.bfr_land_pos = bfr_land_pos;
+  if (scheduled) {
+    key.dt = sched_param.dt;
+    key.sst = sched_param.sst;
+    key.dst = sched_param.dst;
+    key.cogh = sched_param.cogh;
+    key.legh = sched_param.legh;
+  } else {
+    key.dt = dt;
+    key.sst = single_sup_time;
+    key.dst = double_sup_time;
+    key.cogh = cog_h;
+    key.legh = leg_h;
+  }
+  key.ground_h = lift_h;
+  key.land_h = ref_land_pose[swingleg].p().z();
+  key.obstacle_h = obstacle_h;
+  key.swingleg = swingleg;
+
+  const StepSegment* seg = stepcache.find(key);
+  if (seg) {
+    comtrack.calcRefZMP(end_cp, seg->param);
+    legtrack.setStepVar(ref_land_pose, ref_waist_pose.q(), swingleg, wstate,
+                        *seg);
+  } else {
+    StepParam sp;
+    if (scheduled) {
+      sp = sched_param;
+      sp.setSwing(lift_h, key.land_h, obstacle_h);
+    } else {
+      sp.set(dt, single_sup_time, double_sup_time, cog_h, leg_h,
+             lift_h, key.land_h, obstacle_h);
+    }
+    comtrack.calcRefZMP(end_cp, sp);
+    legtrack.setStepVar(ref_land_pose, ref_waist_pose.q(), swingleg, wstate,
+                        sp, stepcache.insert(key));
+  }
+}
+
+// @brief advance time and switch walking state if finished a step
+void cpgen::updateWstate() {
   step_delta_time += dt;
-  if (step_delta_time >= double_sup_time + single_sup_time) {
+  if (step_delta_time >= getStepTime()) {
     swingleg = swingleg == right ? left : right;
     if (wstate == starting1) {
       wstate = starting2;
@@ -153,7 +539,7 @@ void cpgen::calcNextFootprint(const Vector3& step_vector, double step_angle,
   // calc footprints
   Vector3 ref_land_pose_p = ref_waist_pose.p() +
                             ref_waist_pose.q() * dist_body2foot[swingleg];
-  Quat ref_land_pose_q    = ref_waist_pose.q() * init_feet_pose[0].q();
+  Quat ref_land_pose_q    = ref_waist_pose.q() * waist2foot[swingleg];
   ref_land_pose[swingleg].set(ref_land_pose_p, ref_land_pose_q);
 }
 
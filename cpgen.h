@@ -2,16 +2,29 @@
 #define CPGEN_CPGEN_H_
 
 #include <cmath>
+#include <deque>
 
 #include "com_track.h"
 #include "leg_track.h"
 #include "plan_footprints.h"
+#include "leg_ik.h"
+#include "heightmap.h"
+#include "support_polygon.h"
 
 namespace cp {
 
+// timing and height of a step
+struct StepSchedule {
+  double sst;   // single support time [s]
+  double dst;   // double support time [s]
+  double cogh;  // height of center of gravity [m], CoM goes to it in the
+                // step and back after the queued steps
+  double legh;  // height of up leg above terrain [m]
+};
+
 class cpgen {
  public:
-  cpgen() {}
+  cpgen() : legacy_step(false), heightmap(NULL) {stepcache.setCapacity(8);}
   ~cpgen() {}
 
   void initialize(
@@ -21,23 +34,96 @@ class cpgen {
       double t, double sst, double dst, double cogh, double legh);
   void setup(double t, double sst, double dst, double cogh, double legh);
 
+  // after estop, the walk is resumed from the frozen state and step
   void start();
   void stop();
+  // pattern is frozen at once. start() resumes it from the frozen state.
+  // to abandon the frozen step (e.g. the robot was put down or moved),
+  // initialize again with the present pose, then start() begins a new walk.
   void estop();
 
+  // landing position of the next step relative to the last one.
+  // it is not used in starting1, stopping1 and stopping2, where legs do
+  // not move or are put together.
   void setLandPos(const Vector3& pos);
 
+  // footsteps with their own timing and height, used one per step in
+  // order instead of setLandPos and setup (except the first and the last
+  // two steps, where legs do not move or are put together). setLandPos
+  // is used again when the queue is empty.
+  // constants of the step are calculated here, not in the control cycle.
+  void pushStep(const Vector3& pos, const StepSchedule& sched);
+  size_t getQueuedSteps() {return step_queue.size();}
+  void clearSteps() {step_queue.clear();}
+
   void getWalkingPattern(Vector3* com_pos, Quat* waist_r,
                          Pose* right_leg_pose, Pose* left_leg_pose);
+  void getWalkingPattern(WalkingPattern* wp);
+  // false if leg geometry is not set (setLegGeometry) or out of reach
+  bool getWalkingPattern(WalkingPattern* wp, Vector6 leg_q[]);
+
+  // inverse kinematics stage (hip offset is taken from initial leg pose).
+  // it can be set before or after initialize.
+  void setLegGeometry(const LegGeometry& geo);
+  LegIK& getLegIK() {return legik;}
+
+  // quaternion interpolation of legs and waist by precomputed axis/angle
+  // (default: true). false uses Quaterniond::slerp every cycle.
+  void setFastSlerp(bool fast) {legtrack.setFastSlerp(fast);}
+
+  // cache of step constants for periodic walking (default: 8 steps).
+  // 0 disables the cache. it can be set before or after initialize, and
+  // clears the cached steps and stats.
+  void setStepCache(size_t capacity) {stepcache.setCapacity(capacity);}
+  StepCacheStats getStepCacheStats() {return stepcache.getStats();}
+
+  // calculate the constants of every step in the control cycle from setup
+  // (or the schedule) without StepParam and step cache, as before they
+  // were added (default: false). reference of the conformance check.
+  void setLegacyStep(bool legacy) {legacy_step = legacy;}
+
+  // step timing, landing position and ZMP adaptation by measured CP.
+  // setMeasuredCP is used by the next getWalkingPattern. The pattern of
+  // the step is not changed while CP error is in sa.cp_margin.
+  void setStepAdaptation(const StepAdaptParam& sa, bool enable = true);
+  void setMeasuredCP(const Vector2& cp);
+  double getAdaptError() {return adapt_error;}
+
+  // terrain of landing positions and swing leg clearance (NULL: flat).
+  // CoM (and waist) goes up and down with the mean height of the feet in
+  // each step, so cogh is the height from the feet, not from the world.
+  // swing leg clearance is checked under the whole sole swept from lift off
+  // to landing. map is not copied, it must be alive while walking.
+  void setHeightMap(const HeightMap* map, const FootGeometry& sole) {
+    heightmap = map;
+    this->sole = sole;
+  }
 
   rl getSwingleg() {return swingleg;}
+  rl getNextSwingleg();
   Vector2 getRefZMP() {return comtrack.getRefZMP();}
   walking_state getWstate() {return wstate;}
+  // true if next getWalkingPattern starts a new step. the step time is
+  // the one latched at the start of the step, setup changes it from the
+  // next step
+  bool isStepBoundary() {return step_delta_time >= getStepTime();}
 
  private:
   void calcNextFootprint(const Vector3& step_vector, double step_angle,
                          Pose& ref_waist_pose, Pose ref_land_pose[]);
   Vector2 calcEndCP(const Pose ref_land_pose[]);
+  void updateStep();
+  void popStep();
+  void calcTerrain(const Pose& lift_pose);
+  bool getSweptHeight(const Vector3& lift, const Vector3& land, double* h);
+  void planCoMHeight(double t_now, double t);
+  void calcCoMHeight(double t, double* z, double* dz, double* ddz);
+  void addCoMHeight(Vector3* com_pos, Vector3* com_vel, Vector3* com_acc);
+  void setStepVar(const Vector3& cmd);
+  void updateWstate();
+  void adaptStep();
+  // time of this step. setup changes the time from the next step
+  double getStepTime() {return legtrack.getStepTime();}
 
   // no use
   void calcLandPos();
@@ -47,6 +133,9 @@ class cpgen {
 
   CoMTrack comtrack;
   LegTrack legtrack;
+  LegIK legik;
+  StepCache stepcache;
+  bool legacy_step;  // constants of a step without StepParam
   // PlanFootprints pf;
 
   // parameter
@@ -54,17 +143,63 @@ class cpgen {
   double single_sup_time;  // single support time [s]
   double double_sup_time;  // double support time [s]
   double cog_h;            // height of center of gravity [m]
-  double leg_h;            // height of up leg [m]
+  double leg_h;            // height of up leg above terrain [m]
 
   Quat base2leg[2];
 
   Vector3 land_pos;         // landing position x[m], y[m], theta[rad]
+  Vector3 bfr_land_pos;     // landing position of the step before
   rl swingleg;              // which swing leg(0: right, 1: left)
   walking_state wstate;     // now walking state (definition is eigen_types.h)
+  walking_state estop_state;  // walking state frozen by estop
   double end_cp_offset[2];
 
-  Vector3 dist_body2foot[2];
+  Vector3 dist_body2foot[2];  // foot position in waist coordinate
+  Quat waist2foot[2];         // foot rotation in waist coordinate
   Pose init_feet_pose[2], init_waist_pose;
+  Vector3 com2waist;  // waist position from CoM (at cogh) in waist coordinate
+
+  // walking pattern state
+  double step_delta_time;
+  Vector2 end_cp;
+  Pose ref_waist_pose;
+  Pose ref_land_pose[2];
+  Pose leg_pose[2];
+
+  // step adaptation
+  StepAdaptParam adapt_param;
+  bool adapt_enable;
+  bool cp_measured;
+  bool adapting;  // track of this step follows measured CP
+  Vector2 measured_cp;
+  Vector2 land_nom, end_cp_nom;  // nominal of this step
+  double st_nom;
+  double adapt_error;
+
+  // step schedule
+  struct QueuedStep {
+    Vector3 land_pos;
+    StepParam param;
+  };
+  std::deque<QueuedStep> step_queue;
+  bool scheduled;          // this step is from step_queue
+  Vector3 sched_land_pos;  // command of this step if scheduled
+  StepParam sched_param;   // constants of this step if scheduled
+
+  // terrain
+  const HeightMap* heightmap;
+  FootGeometry sole;  // sole of both legs (left is mirrored)
+  double lift_yaw;    // yaw of swing leg at lift off in this step
+  double lift_h;      // height of swing leg at lift off in this step
+  double obstacle_h;  // highest terrain under swing leg in this step
+  double base_h;      // mean height of feet at initialize
+  double base_cogh;   // cogh at initialize (CoM height of CoMTrack)
+  interpolation<double> inter_com_z;  // CoM height by terrain and
+                                      // scheduled cogh in this step
+  double com_z_t0, com_z_T;           // start and length of inter_com_z
+
+ public:
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 };
 
 }  // namespace cp
@@ -96,6 +96,11 @@ inline Quat rpy2q(double roll, double pitch, double yaw) {
 inline Matrix3 rpy2mat(double r, double p, double y){return rpy2q(r, p, y).matrix();}
 inline Vector3 mat2rpy(Matrix3 mat) { return mat.eulerAngles(0, 1, 2); }
 inline Vector3 q2rpy(Quat q) { return mat2rpy(q.toRotationMatrix()); }
+// heading around the world z axis (of the x axis of q) in (-PI, PI]
+inline double q2yaw(const Quat& q) {
+  return std::atan2(2.0*(q.x()*q.y() + q.w()*q.z()),
+                    1.0 - 2.0*(q.y()*q.y() + q.z()*q.z()));
+}
 inline Quat mat2q(Matrix3 mat) {return Quat(mat);}
 
 enum rl { right, left, both };
@@ -152,6 +157,20 @@ class Pose {
 
   EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 };
+
+// walking pattern of a cycle with analytic derivatives (world coordinate)
+struct WalkingPattern {
+  Vector3 com_pos, com_vel, com_acc;
+  Quat waist_r;
+  Vector3 waist_w;                  // waist angular velocity [rad/s]
+  Pose leg_pose[2];                 // 0: right, 1: left
+  Vector3 leg_vel[2], leg_acc[2];
+  Vector2 ref_zmp, ref_cp;
+  rl support;                       // support leg (both: double support)
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
 inline Pose affine2pose(const Affine3d& init_leg_pose) {
   Vector3 trans = init_leg_pose.translation();
   Quat q = Quat(init_leg_pose.rotation());
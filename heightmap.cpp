@@ -0,0 +1,139 @@
+#include "heightmap.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace cp {
+
+// @param path: heightmap file
+// @return: false if the file can not be mapped or is broken
+bool HeightMap::open(const char* path) {
+  close();
+  int fd = ::open(path, O_RDONLY);
+  if (fd < 0) {
+    std::cout << "[cpgen] can not open heightmap " << path << std::endl;
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 ||
+      static_cast<size_t>(st.st_size) < sizeof(HeightMapHeader)) {
+    std::cout << "[cpgen] heightmap is too small " << path << std::endl;
+    ::close(fd);
+    return false;
+  }
+  void* p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (p == MAP_FAILED) {
+    std::cout << "[cpgen] can not map heightmap " << path << std::endl;
+    return false;
+  }
+  const HeightMapHeader* hdr = static_cast<const HeightMapHeader*>(p);
+  size_t cells = static_cast<size_t>(hdr->cols) * hdr->rows;
+  if (std::memcmp(hdr->magic, "CPHM", 4) != 0 || hdr->cols < 2 ||
+      hdr->rows < 2 || !(hdr->resolution > 0.0) ||
+      static_cast<size_t>(st.st_size) <
+          sizeof(HeightMapHeader) + cells * sizeof(float)) {
+    std::cout << "[cpgen] broken heightmap " << path << std::endl;
+    munmap(p, st.st_size);
+    return false;
+  }
+  // footsteps hit the map here and there, read ahead is useless
+  madvise(p, st.st_size, MADV_RANDOM);
+
+  header = hdr;
+  data = reinterpret_cast<const float*>(hdr + 1);
+  map_size = st.st_size;
+  inv_res = 1.0 / hdr->resolution;
+  return true;
+}
+
+void HeightMap::close() {
+  if (header) munmap(const_cast<HeightMapHeader*>(header), map_size);
+  header = NULL;
+  data = NULL;
+  map_size = 0;
+}
+
+// @param[in] x, y: position (world coordinate) [m]
+// @param[out] h: height of terrain [m]
+// @return: false if the height is unknown
+bool HeightMap::getHeight(double x, double y, double* h) const {
+  if (!header) return false;
+  double u = (x - header->origin_x) * inv_res;
+  double v = (y - header->origin_y) * inv_res;
+  if (!(u >= 0.0 && v >= 0.0 && u <= header->cols - 1 &&
+        v <= header->rows - 1)) return false;
+  uint32_t i = static_cast<uint32_t>(u);
+  uint32_t j = static_cast<uint32_t>(v);
+  if (i == header->cols - 1) --i;
+  if (j == header->rows - 1) --j;
+  double fu = u - i, fv = v - j;
+  double h00 = cell(i, j),     h10 = cell(i + 1, j);
+  double h01 = cell(i, j + 1), h11 = cell(i + 1, j + 1);
+  double z = (1.0 - fv) * ((1.0 - fu) * h00 + fu * h10) +
+             fv * ((1.0 - fu) * h01 + fu * h11);
+  if (z != z) return false;  // NaN cell
+  *h = z;
+  return true;
+}
+
+// @brief highest terrain under a sole swept from begin to end, sampled
+// every cell. position and yaw of the sole go linearly.
+// @param[in] begin, end: leg end link x[m], y[m], yaw[rad] (world coordinate)
+// @param[in] lo, hi: corners of the sole rectangle from leg end link
+// (x: forward, y: left) [m]
+// @param[out] h: max height [m]
+// @return: false if no height under the sole is known
+bool HeightMap::getMaxHeight(const Vector3& begin, const Vector3& end,
+                             const Vector2& lo, const Vector2& hi,
+                             double* h) const {
+  if (!header) return false;
+  double yaw = std::remainder(end.z() - begin.z(), 2.0 * PI);
+  // corners move by the turn as well
+  double r = std::sqrt(std::max(lo.x() * lo.x(), hi.x() * hi.x()) +
+                       std::max(lo.y() * lo.y(), hi.y() * hi.y()));
+  double len = (end - begin).head<2>().norm() + r * std::abs(yaw);
+  int n = static_cast<int>(len * inv_res) + 1;
+  int nx = static_cast<int>((hi.x() - lo.x()) * inv_res) + 1;
+  int ny = static_cast<int>((hi.y() - lo.y()) * inv_res) + 1;
+  bool found = false;
+  double z;
+  for (int k = 0; k <= n; ++k) {
+    double s = static_cast<double>(k) / n;
+    Vector2 o = begin.head<2>() + s * (end - begin).head<2>();
+    double a = begin.z() + s * yaw;
+    double c = std::cos(a), sn = std::sin(a);
+    for (int i = 0; i <= nx; ++i) {
+      double x = lo.x() + (hi.x() - lo.x()) * i / nx;
+      for (int j = 0; j <= ny; ++j) {
+        double y = lo.y() + (hi.y() - lo.y()) * j / ny;
+        if (!getHeight(o.x() + c * x - sn * y, o.y() + sn * x + c * y, &z))
+          continue;
+        if (!found || z > *h) *h = z;
+        found = true;
+      }
+    }
+  }
+  return found;
+}
+
+// @brief make a heightmap file
+// @param heights: hdr.cols * hdr.rows heights, row major
+bool HeightMap::write(const char* path, const HeightMapHeader& hdr,
+                      const float* heights) {
+  FILE* fp = std::fopen(path, "wb");
+  if (!fp) return false;
+  HeightMapHeader h = hdr;
+  std::memcpy(h.magic, "CPHM", 4);
+  h.reserved = 0;
+  size_t cells = static_cast<size_t>(h.cols) * h.rows;
+  bool ok = std::fwrite(&h, sizeof(h), 1, fp) == 1 &&
+            std::fwrite(heights, sizeof(float), cells, fp) == cells;
+  return std::fclose(fp) == 0 && ok;
+}
+
+}  // namespace cp
@@ -0,0 +1,60 @@
+#ifndef CPGEN_HEIGHTMAP_H_
+#define CPGEN_HEIGHTMAP_H_
+
+#include <iostream>
+#include <cmath>
+#include <stdint.h>
+
+#include "eigen_types.h"
+
+namespace cp {
+
+// header of heightmap file. float heights (row major, rows along y)
+// follow the header.
+struct HeightMapHeader {
+  char magic[4];      // "CPHM"
+  uint32_t cols;      // number of cells along x
+  uint32_t rows;      // number of cells along y
+  uint32_t reserved;
+  double origin_x;    // position of cell (0, 0) [m]
+  double origin_y;
+  double resolution;  // size of a cell [m]
+};
+
+// 2.5D heightmap of terrain (world coordinate).
+// The file is memory mapped and read only, so only touched pages are
+// loaded by the OS. Lookup is bilinear interpolation of 4 cells.
+// NaN cells and outside of the map are unknown.
+class HeightMap {
+ public:
+  HeightMap() : header(NULL), data(NULL), map_size(0) {}
+  ~HeightMap() {close();}
+
+  bool open(const char* path);
+  void close();
+  bool isOpen() const {return header != NULL;}
+
+  bool getHeight(double x, double y, double* h) const;
+  bool getMaxHeight(const Vector3& begin, const Vector3& end,
+                    const Vector2& lo, const Vector2& hi, double* h) const;
+
+  static bool write(const char* path, const HeightMapHeader& hdr,
+                    const float* heights);
+
+ private:
+  HeightMap(const HeightMap&);
+  HeightMap& operator=(const HeightMap&);
+
+  float cell(uint32_t i, uint32_t j) const {
+    return data[static_cast<size_t>(j) * header->cols + i];
+  }
+
+  const HeightMapHeader* header;
+  const float* data;
+  size_t map_size;
+  double inv_res;
+};
+
+}  // namespace cp
+
+#endif  // CPGEN_HEIGHTMAP_H_
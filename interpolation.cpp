@@ -18,6 +18,30 @@ Quat interpolation<Quat>::lerp(Quat begin, Quat end, double lent, double nowt) {
     return (begin.slerp(normt, end));
 }
 
+template <typename T>
+T interpolation<T>::dlerp(T begin, T end, double lent) {
+    if (lent == 0.0) return (end - end);
+    return ((end - begin) / lent);
+}
+
+template<>
+Quat interpolation<Quat>::dlerp(Quat begin, Quat end, double lent) {
+    std::cout << "[cpgen] dlerp is not correspond Quaternion. use slerpAngularVel" << std::endl;
+    return Quat();
+}
+
+// slerp rotates around a fixed axis at a constant rate,
+// so angular velocity is constant through the interpolation
+Vector3 slerpAngularVel(const Quat& begin, const Quat& end, double lent) {
+    if (lent == 0.0) return Vector3::Zero();
+    Quat delta = begin.conjugate() * end;
+    if (delta.w() < 0.0) delta.coeffs() = -delta.coeffs();  // shortest path
+    double s = delta.vec().norm();
+    if (s < 1e-12) return Vector3::Zero();
+    double angle = 2.0 * atan2(s, delta.w());
+    return begin * (delta.vec() * (angle / (s * lent)));
+}
+
 
 template <typename T>
 void interpolation<T>::setInter5(T xb, T dxb, T ddxb, T xe, T dxe, T ddxe, double t) {
@@ -46,6 +70,93 @@ Quat interpolation<Quat>::inter5(double t) {
     return Quat();
 }
 
+template <typename T>
+T interpolation<T>::dinter5(double t) {
+    return (a[1] + 2.0*a[2]*t + 3.0*a[3]*pow(t, 2) + 4.0*a[4]*pow(t, 3) + 5.0*a[5]*pow(t, 4));
+}
+
+template<>
+Quat interpolation<Quat>::dinter5(double t) {
+    std::cout << "[cpgen] inter5 is not correspond Quaternion" << std::endl;
+    return Quat();
+}
+
+template <typename T>
+T interpolation<T>::ddinter5(double t) {
+    return (2.0*a[2] + 6.0*a[3]*t + 12.0*a[4]*pow(t, 2) + 20.0*a[5]*pow(t, 3));
+}
+
+template<>
+Quat interpolation<Quat>::ddinter5(double t) {
+    std::cout << "[cpgen] inter5 is not correspond Quaternion" << std::endl;
+    return Quat();
+}
+
+
+namespace {
+// sin and cos by Taylor series, |x| <= pi/2 (error < 7e-12).
+// coefficients are reciprocals of factorials, so no division in Horner.
+const double s3 = -1.0/6.0, s5 = 1.0/120.0, s7 = -1.0/5040.0,
+             s9 = 1.0/362880.0, s11 = -1.0/39916800.0,
+             s13 = 1.0/6227020800.0, s15 = -1.0/1307674368000.0;
+const double c2 = -1.0/2.0, c4 = 1.0/24.0, c6 = -1.0/720.0,
+             c8 = 1.0/40320.0, c10 = -1.0/3628800.0,
+             c12 = 1.0/479001600.0, c14 = -1.0/87178291200.0,
+             c16 = 1.0/20922789888000.0;
+inline void sincosPoly(double x, double* sn, double* cs) {
+    double x2 = x*x;
+    *sn = x*(1.0 + x2*(s3 + x2*(s5 + x2*(s7 + x2*(s9 + x2*(s11 + x2*(s13
+           + x2*s15)))))));
+    *cs = 1.0 + x2*(c2 + x2*(c4 + x2*(c6 + x2*(c8 + x2*(c10 + x2*(c12
+           + x2*(c14 + x2*c16)))))));
+}
+const double nlerp_angle = 1e-4;  // nlerp error is less than 1e-13 below this
+}  // namespace
+
+// @brief calc axis and angle of a step. call only switch swing leg
+void quat_interpolation::set(const Quat& begin, const Quat& end, double lent) {
+    this->begin = begin;
+    this->lent = lent;
+    delta = begin.conjugate() * end;
+    if (delta.w() < 0.0) delta.coeffs() = -delta.coeffs();  // shortest path
+    this->end = begin * delta;
+    double s = delta.vec().norm();
+    half = atan2(s, delta.w());
+    if (lent == 0.0 || s == 0.0) {
+        type = constant;
+        axis = Vector3::UnitZ();
+        return;
+    }
+    axis = delta.vec() / s;
+    type = half < nlerp_angle ? nlerp : slerp;
+}
+
+// @brief use the same relative rotation from another begin
+void quat_interpolation::rebase(const Quat& begin) {
+    this->begin = begin;
+    end = begin * delta;
+}
+
+Quat quat_interpolation::lerp(double nowt) const {
+    if (type == constant) return begin;
+    double normt = nowt/lent;
+    if (type == nlerp) {
+        Quat q;
+        q.coeffs() = (1.0 - normt)*begin.coeffs() + normt*end.coeffs();
+        q.normalize();
+        return q;
+    }
+    double sn, cs;
+    sincosPoly(normt * half, &sn, &cs);
+    return begin * Quat(cs, sn*axis.x(), sn*axis.y(), sn*axis.z());
+}
+
+// angular velocity(world coordinate)
+Vector3 quat_interpolation::angularVel() const {
+    if (type == constant) return Vector3::Zero();
+    return begin * (axis * (2.0 * half / lent));
+}
+
 
 template class interpolation<float>;
 template class interpolation<double>;
@@ -10,12 +10,42 @@ template <typename T>
 class interpolation {
 public:
   T lerp(T begin, T end, double lent, double nowt);
+  T dlerp(T begin, T end, double lent);
 
   void setInter5(T xb, T dxb, T ddxb, T xe, T dxe, T ddxe, double t);
   T inter5(double t);
+  T dinter5(double t);
+  T ddinter5(double t);
 
 private:
   T a[6];
 };
+
+// angular velocity(world coordinate) of slerp from begin to end in lent [s]
+Vector3 slerpAngularVel(const Quat& begin, const Quat& end, double lent);
+
+// Slerp with rotation axis and angle calculated once by set().
+// lerp() evaluates sin/cos of the half angle (<= pi/2) by polynomials,
+// error of the result is less than 1e-11.
+// Small rotations use nlerp.
+class quat_interpolation {
+public:
+  quat_interpolation() : type(constant), lent(0.0), half(0.0) {}
+
+  void set(const Quat& begin, const Quat& end, double lent);
+  void rebase(const Quat& begin);
+  Quat lerp(double nowt) const;
+  Vector3 angularVel() const;
+
+private:
+  enum inter_type { constant, nlerp, slerp };
+
+  inter_type type;
+  Quat begin, end;
+  Quat delta;     // rotation from begin to end in begin coordinate
+  Vector3 axis;   // rotation axis in begin coordinate
+  double lent;
+  double half;    // half of rotation angle [rad]
+};
 }  // namespace cp
 #endif // CPGEN_INTERPOLATION_H
@@ -0,0 +1,105 @@
+#include "leg_ik.h"
+
+namespace cp {
+
+// @param geo: leg geometry
+// @param hip_offset[right, left]: (x, y) of hip joint in waist coordinate
+// @param com2waist: waist position from CoM in waist coordinate
+void LegIK::setup(const LegGeometry& geo, const Vector3 hip_offset[],
+                  const Vector3& com2waist) {
+  this->geo = geo;
+  for (int i = 0; i < 2; ++i)
+    hip[i] << hip_offset[i].x(), hip_offset[i].y(), geo.hip_z;
+  this->com2waist = com2waist;
+  enable = true;
+}
+
+// @brief calc joint angles of a cycle
+// @param[in] com, waist_r, leg_pose[right, left]: walking pattern
+// @param[out] leg_q[right, left]: joint angles [rad]
+// @return: false if a leg is out of reach (knee is stretched)
+bool LegIK::calcJoint(const Vector3& com, const Quat& waist_r,
+                      const Pose leg_pose[], Vector6 leg_q[]) {
+  Matrix3 waist_R = waist_r.toRotationMatrix();
+  Vector3 waist_p = com + waist_R * com2waist;
+  bool reach = true;
+  for (int lr = 0; lr < 2; ++lr) {
+    reach &= calcLegJoint(waist_p, waist_R, leg_pose[lr].p(),
+                          leg_pose[lr].q().toRotationMatrix(),
+                          lr, leg_q[lr].data());
+  }
+  return reach;
+}
+
+// @brief calc joint angles of offline trajectory
+// @param[in] traj: walking pattern buffer
+// @param[out] jt: joint angle buffer, resized to traj.size()
+// @return: false if a leg is out of reach in any sample
+bool LegIK::calcJoint(const Trajectory& traj, JointTrajectory* jt) {
+  size_t n = traj.size();
+  jt->resize(n);
+  bool reach = true;
+  double q[6];
+  for (size_t k = 0; k < n; ++k) {
+    Matrix3 waist_R = Quat(traj.waist_q[0][k], traj.waist_q[1][k],
+                           traj.waist_q[2][k], traj.waist_q[3][k])
+                          .toRotationMatrix();
+    Vector3 com(traj.com[0][k], traj.com[1][k], traj.com[2][k]);
+    Vector3 waist_p = com + waist_R * com2waist;
+    for (int lr = 0; lr < 2; ++lr) {
+      Vector3 foot_p(traj.leg_p[lr][0][k], traj.leg_p[lr][1][k],
+                     traj.leg_p[lr][2][k]);
+      Matrix3 foot_R = Quat(traj.leg_q[lr][0][k], traj.leg_q[lr][1][k],
+                            traj.leg_q[lr][2][k], traj.leg_q[lr][3][k])
+                           .toRotationMatrix();
+      reach &= calcLegJoint(waist_p, waist_R, foot_p, foot_R, lr, q);
+      for (int j = 0; j < 6; ++j) jt->q[lr][j][k] = q[j];
+    }
+  }
+  return reach;
+}
+
+// analytic solution of 6-DoF leg (hip yaw-roll-pitch, knee, ankle pitch-roll)
+bool LegIK::calcLegJoint(const Vector3& waist_p, const Matrix3& waist_R,
+                         const Vector3& foot_p, const Matrix3& foot_R,
+                         int lr, double q[]) {
+  const double A = geo.thigh;
+  const double B = geo.shank;
+  Vector3 ankle_p = foot_p + foot_R.col(2) * geo.ankle_z;
+  // hip position seen from ankle
+  Vector3 r = foot_R.transpose() * (waist_p + waist_R * hip[lr] - ankle_p);
+  double C = r.norm();
+
+  // knee
+  bool reach = true;
+  double c5 = (C*C - A*A - B*B) / (2.0*A*B);
+  if (c5 >= 1.0) {
+    q[3] = 0.0;
+    reach = false;
+  } else if (c5 <= -1.0) {
+    q[3] = PI;
+    reach = false;
+  } else {
+    q[3] = acos(c5);
+  }
+
+  // ankle
+  double q6a = asin((A / C) * sin(PI - q[3]));
+  q[5] = atan2(r.y(), r.z());
+  if (q[5] > PI_2) q[5] -= PI;
+  else if (q[5] < -PI_2) q[5] += PI;
+  double sign_z = r.z() >= 0.0 ? 1.0 : -1.0;
+  q[4] = -atan2(r.x(), sign_z * sqrt(r.y()*r.y() + r.z()*r.z())) - q6a;
+
+  // hip
+  Matrix3 R = waist_R.transpose() * foot_R *
+              AngleAxisd(-q[5], Vector3::UnitX()).toRotationMatrix() *
+              AngleAxisd(-q[4] - q[3], Vector3::UnitY()).toRotationMatrix();
+  q[0] = atan2(-R(0, 1), R(1, 1));
+  double cz = cos(q[0]), sz = sin(q[0]);
+  q[1] = atan2(R(2, 1), -R(0, 1)*sz + R(1, 1)*cz);
+  q[2] = atan2(-R(2, 0), R(2, 2));
+  return reach;
+}
+
+}  // namespace cp
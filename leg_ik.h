@@ -0,0 +1,49 @@
+#ifndef CPGEN_LEG_IK_H_
+#define CPGEN_LEG_IK_H_
+
+#include <iostream>
+#include <cmath>
+
+#include "eigen_types.h"
+#include "trajectory.h"
+
+namespace cp {
+
+// geometry of 6-DoF leg
+struct LegGeometry {
+  double hip_z;    // height of hip joint from waist link [m] (minus if below)
+  double thigh;    // length from hip to knee [m]
+  double shank;    // length from knee to ankle [m]
+  double ankle_z;  // height of ankle joint from leg end link [m]
+};
+
+// Analytic inverse kinematics of 6-DoF legs.
+// joint order: hip yaw, hip roll, hip pitch, knee pitch, ankle pitch, ankle roll
+class LegIK {
+ public:
+  LegIK() : enable(false) {}
+  ~LegIK() {}
+
+  void setup(const LegGeometry& geo, const Vector3 hip_offset[],
+             const Vector3& com2waist);
+  bool isEnabled() {return enable;}
+  const LegGeometry& getGeometry() {return geo;}
+
+  bool calcJoint(const Vector3& com, const Quat& waist_r,
+                 const Pose leg_pose[], Vector6 leg_q[]);
+  bool calcJoint(const Trajectory& traj, JointTrajectory* jt);
+
+ private:
+  bool calcLegJoint(const Vector3& waist_p, const Matrix3& waist_R,
+                    const Vector3& foot_p, const Matrix3& foot_R,
+                    int lr, double q[]);
+
+  bool enable;
+  LegGeometry geo;
+  Vector3 hip[2];     // hip joint position in waist coordinate
+  Vector3 com2waist;  // waist position from CoM (at cogh) in waist coordinate
+};
+
+}  // namespace cp
+
+#endif  // CPGEN_LEG_IK_H_
@@ -16,17 +16,24 @@ void LegTrack::init_setup(double sampling_time, double single_sup_time,
 
   ground_h = init_pose[0].p().z();
   waist = waist_r;  ref_waist_r = waist_r;
+  waist_w = Vector3::Zero();
+  adapted = false;
+  support = both;
+  sst_s = dst_s = st_s = 0.0;
+  dt_s = sampling_time;
   setup(sampling_time, single_sup_time, double_sup_time, legh);
 }
 
 // always can change these value
+// @param legh: height of swing leg above the highest of lift off height,
+// landing height and terrain under swing leg (not from initial ground)
 void LegTrack::setup(double sampling_time, double single_sup_time,
                      double double_sup_time, double legh) {
   dt  = sampling_time;
   sst = single_sup_time;
   dst = double_sup_time;
   st  = single_sup_time + double_sup_time;
-  leg_h = legh + ground_h;
+  leg_h = legh;
 }
 
 // @brief set variable of a step. call only switch swing leg
@@ -34,13 +41,95 @@ void LegTrack::setup(double sampling_time, double single_sup_time,
 // @param[in] ref_waist: reference waist rotation
 // @param[in] swingleg: next step swing leg
 // @param[in] wstate: next step walking state
+// @param[in] obstacle_h: highest terrain under swing leg
 void LegTrack::setStepVar(const Pose ref_landpose_leg_w[],
-     const Quat &ref_waist, rl swingleg, walking_state wstate) {
+     const Quat &ref_waist, rl swingleg, walking_state wstate,
+     double obstacle_h) {
   // set time var of a step
   sst_s = sst;
   dst_s = dst;
   dt_s  = dt;
   st_s = sst_s + dst_s;
+  setLandPose(ref_landpose_leg_w, ref_waist, swingleg, wstate);
+
+  // set even if not used, setFastSlerp can switch it in the middle of step
+  rl spl = swl == right ? left : right;
+  inter_swl_q.set(bfr_landpose[swl].q(), ref_landpose[swl].q(), sst_s);
+  inter_spl_q.set(bfr_landpose[spl].q(), ref_landpose[spl].q(), sst_s);
+  inter_waist_q.set(bfr_waist_r, ref_waist_r, sst_s);
+  if (fast_slerp) {
+    waist_w_s = inter_waist_q.angularVel();
+  } else {
+    waist_w_s = slerpAngularVel(bfr_waist_r, ref_waist_r, sst_s);
+  }
+  waist_w_q = waist_w_s;
+  // for z lerp, from lift off height to landing height
+  double h0 = bfr_landpose[swl].p().z();
+  double h1 = ref_landpose[swl].p().z();
+  top_h = leg_h + std::max(std::max(h0, h1), obstacle_h);
+  legh_s = leg_h;
+  inter_z_1.setInter5(h0, 0.0, 0.0, top_h, 0.0, 0.0, sst*0.5);
+  inter_z_2.setInter5(top_h, 0.0, 0.0, h1, 0.0, 0.0, sst*0.5);
+}
+
+// @brief set variable of a step by precomputed constants
+// @param[in] sp: constants of this step
+// @param[out] seg: if not NULL, rotations of this step are stored for reuse
+void LegTrack::setStepVar(const Pose ref_landpose_leg_w[],
+     const Quat &ref_waist, rl swingleg, walking_state wstate,
+     const StepParam& sp, StepSegment* seg) {
+  setStepParam(sp);
+  setLandPose(ref_landpose_leg_w, ref_waist, swingleg, wstate);
+
+  rl spl = swl == right ? left : right;
+  inter_swl_q.set(bfr_landpose[swl].q(), ref_landpose[swl].q(), sst_s);
+  inter_spl_q.set(bfr_landpose[spl].q(), ref_landpose[spl].q(), sst_s);
+  inter_waist_q.set(bfr_waist_r, ref_waist_r, sst_s);
+  waist_w_s = inter_waist_q.angularVel();
+  waist_w_q = waist_w_s;
+  if (seg) {
+    seg->param = sp;
+    seg->swl_q = inter_swl_q;
+    seg->spl_q = inter_spl_q;
+    seg->waist_q = inter_waist_q;
+  }
+}
+
+// @brief set variable of a step by cached segment
+// @param[in] seg: constants and relative rotations of this step
+void LegTrack::setStepVar(const Pose ref_landpose_leg_w[],
+     const Quat &ref_waist, rl swingleg, walking_state wstate,
+     const StepSegment& seg) {
+  setStepParam(seg.param);
+  setLandPose(ref_landpose_leg_w, ref_waist, swingleg, wstate);
+
+  rl spl = swl == right ? left : right;
+  inter_swl_q = seg.swl_q;
+  inter_spl_q = seg.spl_q;
+  inter_waist_q = seg.waist_q;
+  inter_swl_q.rebase(bfr_landpose[swl].q());
+  inter_spl_q.rebase(bfr_landpose[spl].q());
+  inter_waist_q.rebase(bfr_waist_r);
+  waist_w_s = inter_waist_q.angularVel();
+  waist_w_q = waist_w_s;
+}
+
+void LegTrack::setStepParam(const StepParam& sp) {
+  sst_s = sp.sst;
+  dst_s = sp.dst;
+  dt_s  = sp.dt;
+  st_s = sp.st;
+  top_h = sp.leg_h;
+  legh_s = sp.legh;
+  inter_z_1 = sp.inter_z_1;
+  inter_z_2 = sp.inter_z_2;
+}
+
+// set landing pose of a step and (x, y) lerp of swing leg
+void LegTrack::setLandPose(const Pose ref_landpose_leg_w[],
+     const Quat &ref_waist, rl swingleg, walking_state wstate) {
+  adapted = false;
+  sst_q = sst_s;
   swl = swingleg;
   ws = wstate;
   // set next landing pos
@@ -54,16 +143,29 @@ void LegTrack::setStepVar(const Pose ref_landpose_leg_w[],
   // for (x, y) lerp
   bfr << bfr_landpose[swl].p().x(), bfr_landpose[swl].p().y();
   ref << ref_landpose[swl].p().x(), ref_landpose[swl].p().y();
-  // for z lerp
-  inter_z_1.setInter5(ground_h, 0.0, 0.0, leg_h, 0.0, 0.0, sst*0.5);
-  inter_z_2.setInter5(leg_h, 0.0, 0.0, ground_h, 0.0, 0.0, sst*0.5);
+  swing_vel = inter_vec2.dlerp(bfr, ref, sst_s);
 }
 
 // @brief calculate next roop leg pose
 // @param[in] t: delta step time.  0 <= t < single support time + double support time
 // @param[out] r_leg_pose: return next roop leg pose
 void LegTrack::getLegTrack(double t, Pose r_leg_pose[]) {
+  Vector3 leg_vel[2], leg_acc[2];
+  getLegTrack(t, r_leg_pose, leg_vel, leg_acc);
+}
+
+// @brief calculate next roop leg pose with analytic velocity and acceleration
+// @param[in] t: delta step time.  0 <= t < single support time + double support time
+// @param[out] r_leg_pose: return next roop leg pose
+// @param[out] r_leg_vel: return next roop leg velocity
+// @param[out] r_leg_acc: return next roop leg acceleration
+void LegTrack::getLegTrack(double t, Pose r_leg_pose[],
+                           Vector3 r_leg_vel[], Vector3 r_leg_acc[]) {
   rl spl = swl == right ? left : right;
+  r_leg_vel[right] = r_leg_vel[left] = Vector3::Zero();
+  r_leg_acc[right] = r_leg_acc[left] = Vector3::Zero();
+  waist_w = Vector3::Zero();
+  support = both;
   if (ws == starting1 || ws == stopping2) {
       r_leg_pose[right].set(bfr_landpose[right]);
       r_leg_pose[left].set(bfr_landpose[left]);
@@ -71,27 +173,140 @@ void LegTrack::getLegTrack(double t, Pose r_leg_pose[]) {
     if (t < dst_s*0.5) {
         r_leg_pose[swl].set(bfr_landpose[swl]);
         r_leg_pose[spl].set(bfr_landpose[spl].q());
-    } else if (t < dst_s*0.5 + sst_s*0.5) {
-        double sst_s_time = t - dst_s*0.5;
-        Vector2 nex = inter_vec2.lerp(bfr, ref, sst_s, sst_s_time);
-        r_leg_pose[swl].set(Vector3(nex.x(), nex.y(), inter_z_1.inter5(sst_s_time)));
-        r_leg_pose[swl].set(inter_q.lerp(bfr_landpose[swl].q(), ref_landpose[swl].q(), sst_s, sst_s_time));
-        r_leg_pose[spl].set(inter_q.lerp(bfr_landpose[spl].q(), ref_landpose[spl].q(), sst_s, sst_s_time));
-        waist = inter_q.lerp(bfr_waist_r, ref_waist_r, sst_s, sst_s_time);
     } else if (t < dst_s*0.5 + sst_s) {
         double sst_s_time = t - dst_s*0.5;
-        double sst_s_ht = sst_s_time - sst_s*0.5;
-        Vector2 nex = inter_vec2.lerp(bfr, ref, sst_s, sst_s_time);
-        r_leg_pose[swl].set(Vector3(nex.x(), nex.y(), inter_z_2.inter5(sst_s_ht)));
-        r_leg_pose[swl].set(inter_q.lerp(bfr_landpose[swl].q(), ref_landpose[swl].q(), sst_s, sst_s_time));
-        r_leg_pose[spl].set(inter_q.lerp(bfr_landpose[spl].q(), ref_landpose[spl].q(), sst_s, sst_s_time));
-        waist = inter_q.lerp(bfr_waist_r, ref_waist_r, sst_s, sst_s_time);
+        Vector3 pos;
+        calcSwing(sst_s_time, &pos, &r_leg_vel[swl], &r_leg_acc[swl]);
+        r_leg_pose[swl].set(pos);
+        lerpQuat(sst_s_time, r_leg_pose);
+        waist_w = waist_w_s;
+        support = spl;
     } else if (t <= st_s) {
         r_leg_pose[swl].set(ref_landpose[swl]);
         r_leg_pose[spl].set(ref_landpose[spl]);
+        // the last single support cycle is short of the end of rotation
+        waist = ref_waist_r;
     }
     r_leg_pose[spl].set(bfr_landpose[spl].p());
   }
 }
 
+// @brief swing leg position, velocity and acceleration in single support phase
+// @param[in] sst_s_time: time from the start of single support phase
+void LegTrack::calcSwing(double sst_s_time, Vector3* pos, Vector3* vel,
+                         Vector3* acc) {
+  if (adapted) {
+    double ta = sst_s_time - ad_t0;
+    Vector2 xy = inter_ad_xy.inter5(ta);
+    Vector2 dxy = inter_ad_xy.dinter5(ta);
+    Vector2 ddxy = inter_ad_xy.ddinter5(ta);
+    // inter_ad_z2 is used only after the top
+    bool down = ad_rising && ta >= ad_t1;
+    interpolation<double>& iz = down ? inter_ad_z2 : inter_ad_z1;
+    double tz = down ? ta - ad_t1 : ta;
+    *pos << xy.x(), xy.y(), iz.inter5(tz);
+    *vel << dxy.x(), dxy.y(), iz.dinter5(tz);
+    *acc << ddxy.x(), ddxy.y(), iz.ddinter5(tz);
+    return;
+  }
+  Vector2 nex = inter_vec2.lerp(bfr, ref, sst_s, sst_s_time);
+  if (sst_s_time < sst_s*0.5) {
+    *pos << nex.x(), nex.y(), inter_z_1.inter5(sst_s_time);
+    *vel << swing_vel.x(), swing_vel.y(), inter_z_1.dinter5(sst_s_time);
+    *acc << 0.0, 0.0, inter_z_1.ddinter5(sst_s_time);
+  } else {
+    double sst_s_ht = sst_s_time - sst_s*0.5;
+    *pos << nex.x(), nex.y(), inter_z_2.inter5(sst_s_ht);
+    *vel << swing_vel.x(), swing_vel.y(), inter_z_2.dinter5(sst_s_ht);
+    *acc << 0.0, 0.0, inter_z_2.ddinter5(sst_s_ht);
+  }
+}
+
+// time of rotation interpolation, which is stretched after adaptStep
+double LegTrack::rotTime(double sst_s_time) {
+  if (!adapted) return sst_s_time;
+  return sst_q * (ad_s0 + (1.0 - ad_s0) * (sst_s_time - ad_t0) / ad_T);
+}
+
+// rotation of legs and waist in single support phase
+void LegTrack::lerpQuat(double sst_s_time, Pose r_leg_pose[]) {
+  rl spl = swl == right ? left : right;
+  double tq = rotTime(sst_s_time);
+  if (fast_slerp) {
+    r_leg_pose[swl].set(inter_swl_q.lerp(tq));
+    r_leg_pose[spl].set(inter_spl_q.lerp(tq));
+    waist = inter_waist_q.lerp(tq);
+  } else {
+    r_leg_pose[swl].set(inter_q.lerp(bfr_landpose[swl].q(), ref_landpose[swl].q(), sst_q, tq));
+    r_leg_pose[spl].set(inter_q.lerp(bfr_landpose[spl].q(), ref_landpose[spl].q(), sst_q, tq));
+    waist = inter_q.lerp(bfr_waist_r, ref_waist_r, sst_q, tq);
+  }
+}
+
+// @brief position of swing leg at delta step time t
+// (clamped to the single support phase)
+Vector3 LegTrack::getSwingPos(double t) {
+  double tc = std::min(std::max(t - dst_s*0.5, 0.0), sst_s);
+  Vector3 pos, vel, acc;
+  calcSwing(tc, &pos, &vel, &acc);
+  return pos;
+}
+
+// @brief change landing position and single support time during a step.
+// swing leg track is planned again from the present state, so it does not jump.
+// @param[in] t: delta step time
+// @param[in] land: new landing position (x, y)
+// @param[in] land_h: height of ground at new landing position
+// @param[in] obstacle_h: highest terrain under swing leg from now to landing
+// @param[in] sst_new: new single support time of this step
+void LegTrack::adaptStep(double t, const Vector2& land, double land_h,
+                         double obstacle_h, double sst_new) {
+  if (ws == starting1 || ws == stopping2) return;
+  double tc = t - dst_s*0.5;
+  if (tc >= sst_s) return;  // already landed
+  if (tc < 0.0) tc = 0.0;
+
+  Vector3 pos, vel, acc;
+  calcSwing(tc, &pos, &vel, &acc);
+  if (tc == 0.0 && !adapted) {
+    pos << bfr.x(), bfr.y(), bfr_landpose[swl].p().z();
+    vel = acc = Vector3::Zero();
+  }
+  bool rising = adapted ? (ad_rising && tc - ad_t0 < ad_t1) : tc < sst_s*0.5;
+  double s0 = rotTime(tc) / sst_q;
+  double T = sst_new - tc;
+
+  inter_ad_xy.setInter5(pos.head<2>(), vel.head<2>(), acc.head<2>(),
+                        land, Vector2::Zero(), Vector2::Zero(), T);
+  // the top is kept at the time of the track followed up to now. a raised
+  // top (by the leg height of this step) is reached at the middle of the
+  // rest of swing, so that the leg does not jump up just before the top
+  double t_apex = std::min((adapted ? ad_t0 + ad_t1 : sst_s*0.5) - tc, T*0.5);
+  double top = std::max(top_h, std::max(land_h, obstacle_h) + legh_s);
+  if (top > top_h) t_apex = T*0.5;
+  top_h = top;
+  if (rising && t_apex > 0.0) {
+    inter_ad_z1.setInter5(pos.z(), vel.z(), acc.z(), top_h, 0.0, 0.0, t_apex);
+    inter_ad_z2.setInter5(top_h, 0.0, 0.0, land_h, 0.0, 0.0, T - t_apex);
+    ad_t1 = t_apex;
+    ad_rising = true;
+  } else {
+    inter_ad_z1.setInter5(pos.z(), vel.z(), acc.z(), land_h, 0.0, 0.0, T);
+    ad_t1 = T;
+    ad_rising = false;
+  }
+  adapted = true;
+  ad_t0 = tc;
+  ad_T = T;
+  ad_s0 = s0;
+  waist_w_s = waist_w_q * ((1.0 - s0) * sst_q / T);
+
+  ref = land;
+  ref_landpose[swl].p().x() = land.x();
+  ref_landpose[swl].p().y() = land.y();
+  ref_landpose[swl].p().z() = land_h;
+  sst_s = sst_new;
+  st_s = dst_s + sst_s;
+}
+
 }  // namespace cp
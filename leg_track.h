@@ -2,9 +2,11 @@
 #define CPGEN_LEG_TRACK_H_
 
 #include <iostream>
+#include <algorithm>
 
 #include "interpolation.h"
 #include "eigen_types.h"
+#include "step_cache.h"
 
 namespace cp {
 
@@ -12,7 +14,7 @@ namespace cp {
 // It used by cpgen class only.
 class LegTrack {
  public:
-  LegTrack() {}
+  LegTrack() : fast_slerp(true) {}
   ~LegTrack() {}
 
   void init_setup(double sampling_time, double single_sup_time,
@@ -21,31 +23,74 @@ class LegTrack {
   void setup(double sampling_time, double single_sup_time,
              double double_sup_time, double legh);
   void setStepVar(const Pose ref_land_pose[], const Quat &ref_waist,
-                  rl swingleg, walking_state wstate);
+                  rl swingleg, walking_state wstate, double obstacle_h);
+  void setStepVar(const Pose ref_land_pose[], const Quat &ref_waist,
+                  rl swingleg, walking_state wstate,
+                  const StepParam& sp, StepSegment* seg);
+  void setStepVar(const Pose ref_land_pose[], const Quat &ref_waist,
+                  rl swingleg, walking_state wstate, const StepSegment& seg);
   void getLegTrack(double t, Pose r_leg_pose[]);
+  void getLegTrack(double t, Pose r_leg_pose[],
+                   Vector3 r_leg_vel[], Vector3 r_leg_acc[]);
   Quat getWaistTrack(double step_delta_time) {return waist;}
+  Vector3 getWaistAngVel(double step_delta_time) {return waist_w;}
+  // use quat_interpolation instead of Quaterniond::slerp (default: true)
+  void setFastSlerp(bool fast) {fast_slerp = fast;}
+  double getGroundHeight() {return ground_h;}
+  void adaptStep(double t, const Vector2& land, double land_h,
+                 double obstacle_h, double sst_new);
+  Vector3 getSwingPos(double t);
+  double getStepTime() {return st_s;}
+  double getSingleSupTime() {return sst_s;}
+  double getDoubleSupTime() {return dst_s;}
+  rl getSupportLeg() {return support;}
   // void getLegTrack(const rl swingleg, const walking_state wstate,
   //                  const Pose ref_landpos_leg_w[],
   //                  std::deque<Pose, Eigen::aligned_allocator<Pose> > r_leg_pos[]);
 
  private:
+  void lerpQuat(double sst_s_time, Pose r_leg_pose[]);
+  void calcSwing(double sst_s_time, Vector3* pos, Vector3* vel, Vector3* acc);
+  double rotTime(double sst_s_time);
+  void setLandPose(const Pose ref_land_pose[], const Quat &ref_waist,
+                   rl swingleg, walking_state wstate);
+  void setStepParam(const StepParam& sp);
+
   interpolation<double> inter_z_1, inter_z_2, inter_d;
   interpolation<Vector2> inter_vec2;
   interpolation<Quat> inter_q;
+  quat_interpolation inter_swl_q, inter_spl_q, inter_waist_q;
+  bool fast_slerp;
   double dt;     // sampling time [s]
   double sst;    // single support time [s]
   double dst;    // double support time [s]
   double st;     // step time = dst + sst
-  double leg_h;  // height of up leg [m]
-  double ground_h;
+  double leg_h;     // height of up leg above the highest of lift off,
+                    // landing and terrain under swing leg [m]
+  double ground_h;  // height of ground at initial pose [m]
 
   // use this step
   double sst_s, dst_s, dt_s, st_s;
+  double top_h;  // top of swing leg (world coordinate) [m]
+  double legh_s;  // height of up leg of this step [m]
 
   Quat waist, ref_waist_r, bfr_waist_r;
   Pose ref_landpose[2];
   Vector2 bfr, ref;
+  Vector2 swing_vel;       // (x, y) velocity of swing leg in this step
+  Vector3 waist_w_s;       // waist angular velocity in this step
+  Vector3 waist_w;
+  Vector3 waist_w_q;       // waist angular velocity over sst_q
+
+  // step adaptation (swing leg is planned again from adapted time)
+  bool adapted;
+  bool ad_rising;          // inter_ad_z1 goes to the top of swing leg
+  double sst_q;            // single support time of rotation interpolation
+  double ad_t0, ad_t1, ad_T, ad_s0;
+  interpolation<Vector2> inter_ad_xy;
+  interpolation<double> inter_ad_z1, inter_ad_z2;
   rl swl;  // swing leg
+  rl support;  // support leg of the last getLegTrack (both: double support)
   walking_state ws;
 
   Pose init_pose[2];
@@ -0,0 +1,51 @@
+#include "pattern_range.h"
+
+namespace cp {
+
+PatternRange::PatternRange(const cpgen& gen,
+                           const std::vector<Vector3>& steps)
+    : gen(gen), steps(steps), step_num(0), cycle(0), calculated(false) {
+  this->gen.start();
+}
+
+PatternRange::PatternRange(const cpgen& gen, PlanPath& path,
+                           const Vector3& goal)
+    : gen(gen), step_num(0), cycle(0), calculated(false) {
+  this->gen.start();
+  steps = path.plan(goal, this->gen.getNextSwingleg());
+}
+
+const WalkingPattern& PatternRange::get() {
+  if (!calculated) calcCycle();
+  return wp;
+}
+
+void PatternRange::next() {
+  if (!calculated) calcCycle();
+  calculated = false;
+  ++cycle;
+}
+
+bool PatternRange::finished() {
+  return !calculated && gen.getWstate() == stopped;
+}
+
+// @brief set footstep of next step if a step is finished and calc a cycle.
+// after the footstep list, the robot puts the feet together and stops.
+void PatternRange::calcCycle() {
+  if (gen.isStepBoundary()) {
+    if (gen.getWstate() == starting1) {
+      // legs do not move in the first step, keep steps[0] for the next
+      gen.setLandPos(Vector3::Zero());
+    } else if (step_num < steps.size()) {
+      gen.setLandPos(steps[step_num++]);
+    } else {
+      gen.setLandPos(Vector3::Zero());
+      gen.stop();
+    }
+  }
+  gen.getWalkingPattern(&wp);
+  calculated = true;
+}
+
+}  // namespace cp
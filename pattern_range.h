@@ -0,0 +1,83 @@
+#ifndef CPGEN_PATTERN_RANGE_H_
+#define CPGEN_PATTERN_RANGE_H_
+
+#include <iterator>
+#include <vector>
+
+#include "cpgen.h"
+#include "plan_path.h"
+
+namespace cp {
+
+// Lazy walking pattern range over a footstep list.
+// A copy of initialized cpgen walks the footsteps and each cycle is
+// calculated only when dereferenced (or skipped by ++), so walks of any
+// length are streamed in constant memory.
+//
+//   cp::PatternRange range(cpgen, steps);  // or (cpgen, plan_path, goal)
+//   for (cp::PatternRange::iterator it = range.begin();
+//        it != range.end(); ++it) {
+//     const cp::WalkingPattern& wp = *it;
+//   }
+class PatternRange {
+ public:
+  // input iterator. all iterators of a range share its generator.
+  class iterator {
+   public:
+    typedef std::input_iterator_tag iterator_category;
+    typedef WalkingPattern value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef const WalkingPattern* pointer;
+    typedef const WalkingPattern& reference;
+
+    iterator() : range(NULL) {}
+    explicit iterator(PatternRange* r) : range(r) {}
+
+    reference operator*() const { return range->get(); }
+    pointer operator->() const { return &range->get(); }
+    iterator& operator++() { range->next(); return *this; }
+    void operator++(int) { range->next(); }
+
+    bool operator==(const iterator& it) const { return isEnd() == it.isEnd(); }
+    bool operator!=(const iterator& it) const { return isEnd() != it.isEnd(); }
+
+   private:
+    bool isEnd() const { return range == NULL || range->finished(); }
+    PatternRange* range;
+  };
+
+  // @param gen: initialized cpgen (copied, the original is not changed)
+  // @param steps: landing position of each step, same as cpgen::setLandPos.
+  // steps[0] is used by the first step that moves a leg (starting2), the
+  // first step (starting1) only shifts the CoM and uses no footstep.
+  PatternRange(const cpgen& gen, const std::vector<Vector3>& steps);
+  // footsteps are planned to goal (x[m], y[m], theta[deg]) by path, from
+  // the swing leg of the first footstep of gen
+  PatternRange(const cpgen& gen, PlanPath& path, const Vector3& goal);
+  ~PatternRange() {}
+
+  iterator begin() { return iterator(this); }
+  iterator end() { return iterator(); }
+
+  size_t getCycle() {return cycle;}
+
+ private:
+  const WalkingPattern& get();
+  void next();
+  bool finished();
+  void calcCycle();
+
+  cpgen gen;
+  std::vector<Vector3> steps;
+  size_t step_num;   // number of used footsteps
+  size_t cycle;      // number of passed cycles
+  bool calculated;   // wp is calculated for this cycle
+  WalkingPattern wp;
+
+ public:
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+}  // namespace cp
+
+#endif  // CPGEN_PATTERN_RANGE_H_
@@ -0,0 +1,150 @@
+#include "plan_path.h"
+
+namespace cp {
+
+namespace {
+inline double clamp(double v, double lo, double hi) {
+  return v < lo ? lo : (v > hi ? hi : v);
+}
+inline double wrapAngle(double a) {
+  return atan2(sin(a), cos(a));
+}
+}  // namespace
+
+// @param lim: limits of a step
+// @param pos_tol: goal tolerance of position [m]
+// @param yaw_tol: goal tolerance of theta [deg]
+// @param max_steps: max number of planned steps
+void PlanPath::setup(const StepLimits& lim, double pos_tol,
+                     double yaw_tol, int max_steps) {
+  this->lim = lim;
+  this->pos_tol = pos_tol;
+  this->yaw_tol = deg2rad(yaw_tol);
+  this->max_steps = max_steps;
+  steps.clear();
+  frames.clear();
+}
+
+// @brief plan footsteps from scratch
+// @param goal: goal waist pose x[m], y[m], theta[deg]
+// @param swingleg: swing leg of the first step (cpgen::getNextSwingleg).
+// the other leg makes the side steps cross the legs
+// @return: commands of cpgen::setLandPos
+const std::vector<Vector3>& PlanPath::plan(const Vector3& goal, rl swingleg) {
+  this->goal << goal.x(), goal.y(), deg2rad(goal.z());
+  plan_goal = this->goal;
+  first_swing = swingleg;
+  steps.clear();
+  frames.clear();
+  planFrom(0, swingleg);
+  ++miss;
+  return steps;
+}
+
+// @brief plan footsteps reusing the last plan if the goal moved slightly.
+// Saturated steps (at the step or turn limit) far from the goal are kept
+// as they are, and only the rest of the path is planned to the new goal.
+// Far steps face the goal position, so they do not depend on goal theta,
+// and a goal moved by replan_tol changes their heading by a small angle
+// which the tail corrects. The kept steps are not the same as plan(), but
+// the path reaches the new goal. Movement is measured from the goal of
+// the last plan(), so the kept steps do not drift by repeated replans.
+// @param goal: goal waist pose x[m], y[m], theta[deg]
+// @param swingleg: swing leg of the first step (cpgen::getNextSwingleg)
+// @param replan_tol: goal movement to reuse the last plan [m]
+// @return: commands of cpgen::setLandPos
+const std::vector<Vector3>& PlanPath::replan(const Vector3& goal, rl swingleg,
+                                             double replan_tol) {
+  Vector3 g(goal.x(), goal.y(), deg2rad(goal.z()));
+  if (frames.empty() || swingleg != first_swing ||
+      (g.head<2>() - plan_goal.head<2>()).norm() > replan_tol) {
+    return plan(goal, swingleg);
+  }
+  this->goal = g;
+  if (isGoal(moveFrame(frames.back(), steps.back()))) {
+    ++hit;
+    return steps;
+  }
+  size_t i = 0;
+  rl swl = swingleg;
+  double far = lim.turn_dist + replan_tol;
+  for (; i < steps.size(); ++i) {
+    if ((g.head<2>() - frames[i].head<2>()).norm() <= far ||
+        !isSaturated(steps[i])) {
+      break;
+    }
+    swl = swl == right ? left : right;
+  }
+  if (i == 0) return plan(goal, swingleg);
+  steps.resize(i);
+  frames.resize(i);
+  planFrom(i, swl);
+  ++hit;
+  return steps;
+}
+
+// plan from the i-th step until the goal
+void PlanPath::planFrom(size_t i, rl swingleg) {
+  Vector3 frame = i == 0 ? Vector3::Zero() : moveFrame(frames[i - 1], steps[i - 1]);
+  for (; static_cast<int>(i) < max_steps; ++i) {
+    if (isGoal(frame)) break;
+    Vector3 step = calcStep(frame, swingleg);
+    frames.push_back(frame);
+    steps.push_back(step);
+    frame = moveFrame(frame, step);
+    swingleg = swingleg == right ? left : right;
+  }
+  if (!isGoal(frame))
+    std::cout << "[cpgen] PlanPath did not reach the goal" << std::endl;
+}
+
+// @brief calc a step command toward the goal
+// @param frame: waist pose x, y, theta[rad] before the step
+// @param swingleg: swing leg of the step
+// @return: step command x[m], y[m], theta[deg]
+Vector3 PlanPath::calcStep(const Vector3& frame, rl swingleg) {
+  double c = cos(frame.z()), s = sin(frame.z());
+  double gx = goal.x() - frame.x(), gy = goal.y() - frame.y();
+  double dx =  c*gx + s*gy;
+  double dy = -s*gx + c*gy;
+  double dyaw = wrapAngle(goal.z() - frame.z());
+
+  // face the goal while far from it, otherwise turn to goal theta
+  double heading = dyaw;
+  if (std::sqrt(dx*dx + dy*dy) > lim.turn_dist) heading = atan2(dy, dx);
+  double max_turn = deg2rad(lim.max_turn);
+  double theta = clamp(heading, -max_turn, max_turn);
+
+  // cpgen turns the waist first, then moves in the turned coordinate
+  double ct = cos(theta), st = sin(theta);
+  double x = clamp( ct*dx + st*dy, -lim.max_back, lim.max_x);
+  double y = clamp(-st*dx + ct*dy, -lim.max_y, lim.max_y);
+  if (std::abs(y) < pos_tol * 0.5) y = 0.0;
+  // do not cross the legs
+  if ((swingleg == right && y > 0.0) || (swingleg == left && y < 0.0)) y = 0.0;
+  return Vector3(x, y, rad2deg(theta));
+}
+
+// same as cpgen::calcNextFootprint on the ground plane
+Vector3 PlanPath::moveFrame(const Vector3& frame, const Vector3& step) {
+  double yaw = frame.z() + deg2rad(step.z());
+  double c = cos(yaw), s = sin(yaw);
+  return Vector3(frame.x() + c*step.x() - s*step.y(),
+                 frame.y() + s*step.x() + c*step.y(),
+                 yaw);
+}
+
+// step command is at the limit of step length or turn
+bool PlanPath::isSaturated(const Vector3& step) {
+  const double eps = 1e-9;
+  return step.x() > lim.max_x - eps || step.x() < -lim.max_back + eps ||
+         std::abs(step.z()) > lim.max_turn - eps;
+}
+
+bool PlanPath::isGoal(const Vector3& frame) {
+  return std::abs(goal.x() - frame.x()) < pos_tol &&
+         std::abs(goal.y() - frame.y()) < pos_tol &&
+         std::abs(wrapAngle(goal.z() - frame.z())) < yaw_tol;
+}
+
+}  // namespace cp
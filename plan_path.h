@@ -0,0 +1,66 @@
+#ifndef CPGEN_PLAN_PATH_H_
+#define CPGEN_PLAN_PATH_H_
+
+#include <iostream>
+#include <vector>
+#include <cmath>
+
+#include "eigen_types.h"
+
+namespace cp {
+
+// limits of a step command (same unit as cpgen::setLandPos)
+struct StepLimits {
+  double max_x;      // forward step length [m]
+  double max_back;   // backward step length [m] (positive value)
+  double max_y;      // side step length [m]
+  double max_turn;   // turn of a step [deg]
+  double turn_dist;  // walk facing the goal if it is farther than this [m]
+};
+
+// Plan footstep commands from current waist pose to a goal pose.
+// Goal is seen from current reference waist (x[m], y[m], theta[deg]) and
+// the result is a list of cpgen::setLandPos commands, one per step.
+// Side steps follow leg crossing rule of PlanFootprints::isCollisionLegs:
+// step to the left only by left leg, to the right only by right leg.
+class PlanPath {
+ public:
+  PlanPath() : hit(0), miss(0) {}
+  ~PlanPath() {}
+
+  void setup(const StepLimits& lim, double pos_tol = 1e-3,
+             double yaw_tol = 0.1, int max_steps = 1000);
+
+  const std::vector<Vector3>& plan(const Vector3& goal, rl swingleg);
+  const std::vector<Vector3>& replan(const Vector3& goal, rl swingleg,
+                                     double replan_tol = 0.05);
+  const std::vector<Vector3>& getSteps() {return steps;}
+  // hit: replans which reused steps of the last plan
+  // miss: plans from scratch (plan and replans which reused no step)
+  size_t getCacheHit() {return hit;}
+  size_t getCacheMiss() {return miss;}
+
+ private:
+  Vector3 calcStep(const Vector3& frame, rl swingleg);
+  Vector3 moveFrame(const Vector3& frame, const Vector3& step);
+  bool isSaturated(const Vector3& step);
+  bool isGoal(const Vector3& frame);
+  void planFrom(size_t i, rl swingleg);
+
+  StepLimits lim;
+  double pos_tol;
+  double yaw_tol;   // [rad]
+  int max_steps;
+
+  // cache of the last plan
+  Vector3 goal;                 // x[m], y[m], theta[rad]
+  Vector3 plan_goal;            // goal of the last plan from scratch
+  rl first_swing;
+  std::vector<Vector3> steps;   // commands, theta[deg]
+  std::vector<Vector3> frames;  // waist (x, y, theta[rad]) before each step
+  size_t hit, miss;
+};
+
+}  // namespace cp
+
+#endif  // CPGEN_PLAN_PATH_H_
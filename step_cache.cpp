@@ -0,0 +1,63 @@
+#include "step_cache.h"
+
+namespace cp {
+
+// @brief set size of the cache. cached steps and stats are cleared
+// @param n: max number of cached steps. 0 disables the cache
+void StepCache::setCapacity(size_t n) {
+  capacity = n;
+  clear();
+  entries.reserve(n);
+}
+
+void StepCache::clear() {
+  entries.clear();
+  hit = 0;
+  miss = 0;
+}
+
+// @return: cached segment of key, NULL if not cached.
+// a disabled cache counts no lookup
+const StepSegment* StepCache::find(const StepKey& key) {
+  if (capacity == 0) return NULL;
+  ++tick;
+  for (size_t i = 0; i < entries.size(); ++i) {
+    if (entries[i].key == key) {
+      entries[i].last_used = tick;
+      ++hit;
+      return &entries[i].seg;
+    }
+  }
+  ++miss;
+  return NULL;
+}
+
+// @brief add a segment of key. least recently used one is evicted if full
+// @return: segment to be filled by caller, NULL if cache is disabled
+StepSegment* StepCache::insert(const StepKey& key) {
+  if (capacity == 0) return NULL;
+  size_t i = entries.size();
+  if (entries.size() < capacity) {
+    entries.push_back(Entry());
+  } else {
+    i = 0;
+    for (size_t j = 1; j < entries.size(); ++j) {
+      if (entries[j].last_used < entries[i].last_used) i = j;
+    }
+  }
+  entries[i].key = key;
+  entries[i].last_used = tick;
+  return &entries[i].seg;
+}
+
+StepCacheStats StepCache::getStats() {
+  StepCacheStats stats;
+  stats.hit = hit;
+  stats.miss = miss;
+  stats.size = entries.size();
+  stats.capacity = capacity;
+  stats.bytes = sizeof(*this) + entries.capacity() * sizeof(Entry);
+  return stats;
+}
+
+}  // namespace cp
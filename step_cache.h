@@ -0,0 +1,77 @@
+#ifndef CPGEN_STEP_CACHE_H_
+#define CPGEN_STEP_CACHE_H_
+
+#include <vector>
+
+#include "eigen_types.h"
+#include "interpolation.h"
+#include "step_param.h"
+
+namespace cp {
+
+// Derived data of a step which does not depend on where the step is.
+// Rotations are kept relative to the start orientation, so they are
+// reused by re-anchoring them to the new start (rigid transform).
+struct StepSegment {
+  StepParam param;
+  quat_interpolation swl_q, spl_q, waist_q;
+};
+
+// key of a step in periodic walking
+struct StepKey {
+  Vector3 land_pos;       // command of this step x[m], y[m], theta[rad]
+  Vector3 bfr_land_pos;   // command of the step before
+  double dt, sst, dst, cogh, legh;
+  double ground_h, land_h, obstacle_h;  // terrain of this step
+  rl swingleg;
+
+  bool operator==(const StepKey& k) const {
+    return land_pos == k.land_pos && bfr_land_pos == k.bfr_land_pos &&
+           dt == k.dt && sst == k.sst && dst == k.dst && cogh == k.cogh &&
+           legh == k.legh && ground_h == k.ground_h && land_h == k.land_h &&
+           obstacle_h == k.obstacle_h && swingleg == k.swingleg;
+  }
+};
+
+struct StepCacheStats {
+  size_t hit;
+  size_t miss;
+  size_t size;      // number of cached steps
+  size_t capacity;  // max number of cached steps
+  size_t bytes;     // memory of the cache [byte]
+};
+
+// Bounded step segment cache with least recently used eviction.
+// In walking, footprints relative to the support leg are given by the
+// commands of this step and the step before, so they are the key.
+class StepCache {
+ public:
+  StepCache() : capacity(0), tick(0), hit(0), miss(0) {}
+  ~StepCache() {}
+
+  void setCapacity(size_t n);
+  void clear();
+
+  const StepSegment* find(const StepKey& key);
+  StepSegment* insert(const StepKey& key);
+
+  StepCacheStats getStats();
+
+ private:
+  struct Entry {
+    StepKey key;
+    StepSegment seg;
+    size_t last_used;
+
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+  };
+
+  std::vector<Entry, Eigen::aligned_allocator<Entry> > entries;
+  size_t capacity;
+  size_t tick;
+  size_t hit, miss;
+};
+
+}  // namespace cp
+
+#endif  // CPGEN_STEP_CACHE_H_
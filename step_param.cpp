@@ -0,0 +1,46 @@
+#include "step_param.h"
+
+namespace cp {
+
+// @brief constants of a step on uneven terrain
+// @param t: sampling time
+// @param single_sup_time: single support time
+// @param double_sup_time: double support time
+// @param cog_h: height center of gravity
+// @param legh: height of up leg from ground
+// @param groundh: height of ground at lift off
+// @param landh: height of ground at landing
+// @param obstacle_h: highest terrain under swing leg
+// swing leg goes up to legh above the highest of them.
+void StepParam::set(double t, double single_sup_time, double double_sup_time,
+                    double cog_h, double legh, double groundh, double landh,
+                    double obstacle_h) {
+  dt = t;
+  sst = single_sup_time;
+  dst = double_sup_time;
+  st = single_sup_time + double_sup_time;
+  cogh = cog_h;
+  this->legh = legh;
+
+  w = sqrt(9.806 / cogh);
+  b = exp(w * st);
+  ground_h = groundh;
+  land_h = landh;
+  leg_h = legh + std::max(std::max(groundh, landh), obstacle_h);
+  inter_z_1.setInter5(ground_h, 0.0, 0.0, leg_h, 0.0, 0.0, sst*0.5);
+  inter_z_2.setInter5(leg_h, 0.0, 0.0, land_h, 0.0, 0.0, sst*0.5);
+}
+
+// @brief swing leg height of a step planned before its terrain is known.
+// splines are made again only if the heights are changed.
+void StepParam::setSwing(double groundh, double landh, double obstacle_h) {
+  double top = legh + std::max(std::max(groundh, landh), obstacle_h);
+  if (groundh == ground_h && landh == land_h && top == leg_h) return;
+  ground_h = groundh;
+  land_h = landh;
+  leg_h = top;
+  inter_z_1.setInter5(ground_h, 0.0, 0.0, leg_h, 0.0, 0.0, sst*0.5);
+  inter_z_2.setInter5(leg_h, 0.0, 0.0, land_h, 0.0, 0.0, sst*0.5);
+}
+
+}  // namespace cp
@@ -0,0 +1,36 @@
+#ifndef CPGEN_STEP_PARAM_H_
+#define CPGEN_STEP_PARAM_H_
+
+#include <cmath>
+#include <algorithm>
+
+#include "interpolation.h"
+#include "eigen_types.h"
+
+namespace cp {
+
+// Constants of a step derived from timing and height parameters.
+// CoMTrack and LegTrack latch these at the start of a step.
+struct StepParam {
+  double dt;        // sampling time [s]
+  double sst;       // single support time [s]
+  double dst;       // double support time [s]
+  double st;        // step time = sst + dst [s]
+  double cogh;      // height of center of gravity [m]
+  double ground_h;  // height of ground at lift off [m]
+  double land_h;    // height of ground at landing [m]
+  double legh;      // height of up leg from ground [m]
+  double leg_h;     // height of the top of swing leg from world origin [m]
+  double w;         // sqrt(g / cogh)
+  double b;         // exp(w * st)
+  interpolation<double> inter_z_1, inter_z_2;  // swing leg height
+
+  void set(double t, double single_sup_time, double double_sup_time,
+           double cog_h, double legh, double groundh, double landh,
+           double obstacle_h);
+  void setSwing(double groundh, double landh, double obstacle_h);
+};
+
+}  // namespace cp
+
+#endif  // CPGEN_STEP_PARAM_H_
@@ -0,0 +1,169 @@
+#include "support_polygon.h"
+
+namespace cp {
+
+namespace {
+inline double cross(const Vector2& o, const Vector2& a, const Vector2& b) {
+  return (a.x() - o.x()) * (b.y() - o.y()) - (a.y() - o.y()) * (b.x() - o.x());
+}
+}  // namespace
+
+void SupportPolygon::setup(const FootGeometry& geo) {
+  this->geo = geo;
+  num = 0;
+}
+
+// @brief make support polygon of this cycle
+// @param leg_pose[right, left]: leg end link pose (world coordinate)
+// @param support: support leg (both: double support)
+void SupportPolygon::update(const Pose leg_pose[], rl support) {
+  Vector2 c[8];
+  if (support == both) {
+    calcSoleCorner(leg_pose[right], right, c);
+    calcSoleCorner(leg_pose[left], left, c + 4);
+    calcConvexHull(c, 8);
+  } else {
+    calcSoleCorner(leg_pose[support], support, v);
+    num = 4;
+  }
+}
+
+// @return: signed distance from p to the edges [m] (plus: inside)
+double SupportPolygon::getMargin(const Vector2& p) const {
+  double inside = 1e10;
+  bool is_inside = true;
+  for (int i = 0; i < num; ++i) {
+    const Vector2& a = v[i];
+    Vector2 e = v[(i + 1) % num] - a;
+    double d = (e.x() * (p.y() - a.y()) - e.y() * (p.x() - a.x())) / e.norm();
+    if (d < 0.0) is_inside = false;
+    if (d < inside) inside = d;
+  }
+  if (is_inside) return inside;
+
+  double outside = 1e10;
+  for (int i = 0; i < num; ++i) {
+    const Vector2& a = v[i];
+    Vector2 e = v[(i + 1) % num] - a;
+    double s = e.dot(p - a) / e.squaredNorm();
+    s = s < 0.0 ? 0.0 : (s > 1.0 ? 1.0 : s);
+    double d = (a + s * e - p).norm();
+    if (d < outside) outside = d;
+  }
+  return -outside;
+}
+
+// @brief margins of offline trajectory.
+// Single support is evaluated by the signed distance of sole rectangle
+// with Eigen arrays, block by block in fixed size buffers on the stack
+// (vectorized, no heap allocation), and only double support samples make
+// the convex hull.
+// @param[in] traj: walking pattern buffer
+// @param[out] zmp_margin, cp_margin: margins, resized to traj.size()
+void SupportPolygon::calcMargin(const Trajectory& traj,
+                                std::vector<double>* zmp_margin,
+                                std::vector<double>* cp_margin) {
+  typedef Eigen::Map<const Eigen::ArrayXd> CMap;
+  const int block = 64;
+  typedef Eigen::Array<double, Eigen::Dynamic, 1, 0, block, 1> Block;
+  const size_t n = traj.size();
+  zmp_margin->resize(n);
+  cp_margin->resize(n);
+
+  const double cx = (geo.front - geo.back) * 0.5;
+  const double hx = (geo.front + geo.back) * 0.5;
+  const double hy = (geo.inner + geo.outer) * 0.5;
+  Block ax, ay, norm, dx, dy, ex, ey;
+  Block margin[2][2];  // [zmp, cp][right, left]
+  Pose leg_pose[2];
+  for (size_t i0 = 0; i0 < n; i0 += block) {
+    const int m = static_cast<int>(std::min<size_t>(block, n - i0));
+    for (int lr = 0; lr < 2; ++lr) {
+      const double cy = lr == right ? (geo.inner - geo.outer) * 0.5
+                                    : (geo.outer - geo.inner) * 0.5;
+      CMap qw(&traj.leg_q[lr][0][i0], m), qx(&traj.leg_q[lr][1][i0], m);
+      CMap qy(&traj.leg_q[lr][2][i0], m), qz(&traj.leg_q[lr][3][i0], m);
+      // x axis of sole on the ground
+      ax = 1.0 - 2.0 * (qy * qy + qz * qz);
+      ay = 2.0 * (qx * qy + qw * qz);
+      norm = (ax * ax + ay * ay).sqrt();
+      ax /= norm;
+      ay /= norm;
+      CMap fx(&traj.leg_p[lr][0][i0], m), fy(&traj.leg_p[lr][1][i0], m);
+      for (int k = 0; k < 2; ++k) {
+        const std::vector<double>* p = k == 0 ? traj.zmp : traj.cp;
+        dx = CMap(&p[0][i0], m) - fx;
+        dy = CMap(&p[1][i0], m) - fy;
+        ex = ( ax * dx + ay * dy - cx).abs() - hx;
+        ey = (-ay * dx + ax * dy - cy).abs() - hy;
+        margin[k][lr] = -((ex.max(0.0).square() + ey.max(0.0).square()).sqrt()
+                          + ex.max(ey).min(0.0));
+      }
+    }
+
+    for (int j = 0; j < m; ++j) {
+      size_t i = i0 + j;
+      int support = traj.support[i];
+      if (support != both) {
+        (*zmp_margin)[i] = margin[0][support](j);
+        (*cp_margin)[i] = margin[1][support](j);
+        continue;
+      }
+      for (int lr = 0; lr < 2; ++lr) {
+        leg_pose[lr].set(Vector3(traj.leg_p[lr][0][i], traj.leg_p[lr][1][i],
+                                 traj.leg_p[lr][2][i]),
+                         Quat(traj.leg_q[lr][0][i], traj.leg_q[lr][1][i],
+                              traj.leg_q[lr][2][i], traj.leg_q[lr][3][i]));
+      }
+      update(leg_pose, both);
+      (*zmp_margin)[i] = getMargin(Vector2(traj.zmp[0][i], traj.zmp[1][i]));
+      (*cp_margin)[i] = getMargin(Vector2(traj.cp[0][i], traj.cp[1][i]));
+    }
+  }
+}
+
+// corners of sole on the ground, counterclockwise
+void SupportPolygon::calcSoleCorner(const Pose& leg_pose, int lr,
+                                    Vector2 c[]) const {
+  const Quat& q = leg_pose.q();
+  Vector2 ax(1.0 - 2.0 * (q.y() * q.y() + q.z() * q.z()),
+             2.0 * (q.x() * q.y() + q.w() * q.z()));
+  ax.normalize();
+  Vector2 ay(-ax.y(), ax.x());
+  Vector2 o(leg_pose.p().x(), leg_pose.p().y());
+  double y_min = lr == right ? -geo.outer : -geo.inner;
+  double y_max = lr == right ?  geo.inner :  geo.outer;
+  c[0] = o - geo.back * ax + y_min * ay;
+  c[1] = o + geo.front * ax + y_min * ay;
+  c[2] = o + geo.front * ax + y_max * ay;
+  c[3] = o - geo.back * ax + y_max * ay;
+}
+
+// monotone chain, counterclockwise. n <= 8
+void SupportPolygon::calcConvexHull(Vector2 p[], int n) {
+  // insertion sort by (x, y)
+  for (int i = 1; i < n; ++i) {
+    Vector2 key = p[i];
+    int j = i - 1;
+    while (j >= 0 && (p[j].x() > key.x() ||
+                      (p[j].x() == key.x() && p[j].y() > key.y()))) {
+      p[j + 1] = p[j];
+      --j;
+    }
+    p[j + 1] = key;
+  }
+  Vector2 h[16];
+  int k = 0;
+  for (int i = 0; i < n; ++i) {
+    while (k >= 2 && cross(h[k - 2], h[k - 1], p[i]) <= 0.0) --k;
+    h[k++] = p[i];
+  }
+  for (int i = n - 2, t = k + 1; i >= 0; --i) {
+    while (k >= t && cross(h[k - 2], h[k - 1], p[i]) <= 0.0) --k;
+    h[k++] = p[i];
+  }
+  num = k - 1;
+  for (int i = 0; i < num; ++i) v[i] = h[i];
+}
+
+}  // namespace cp
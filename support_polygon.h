@@ -0,0 +1,55 @@
+#ifndef CPGEN_SUPPORT_POLYGON_H_
+#define CPGEN_SUPPORT_POLYGON_H_
+
+#include <iostream>
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+#include "eigen_types.h"
+#include "trajectory.h"
+
+namespace cp {
+
+// rectangle of sole seen from leg end link
+struct FootGeometry {
+  double front;  // toe from leg end link [m]
+  double back;   // heel from leg end link [m]
+  double inner;  // inner side (toward the other leg) [m]
+  double outer;  // outer side [m]
+};
+
+// Support polygon of the present walking phase and stability margin.
+// Single support is the sole of support leg and double support is the
+// convex hull of both soles. Margin is signed distance from a point
+// (ZMP or CP) to the edges of polygon, plus inside and minus outside.
+class SupportPolygon {
+ public:
+  SupportPolygon() : num(0) {}
+  ~SupportPolygon() {}
+
+  void setup(const FootGeometry& geo);
+  void update(const Pose leg_pose[], rl support);
+  double getMargin(const Vector2& p) const;
+
+  int size() const {return num;}
+  const Vector2& vertex(int i) const {return v[i];}
+
+  void calcMargin(const Trajectory& traj, std::vector<double>* zmp_margin,
+                  std::vector<double>* cp_margin);
+
+ private:
+  void calcSoleCorner(const Pose& leg_pose, int lr, Vector2 c[]) const;
+  void calcConvexHull(Vector2 p[], int n);
+
+  FootGeometry geo;
+  Vector2 v[8];  // vertices, counterclockwise
+  int num;
+
+ public:
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+}  // namespace cp
+
+#endif  // CPGEN_SUPPORT_POLYGON_H_
@@ -0,0 +1,207 @@
+// Benchmark of a control cycle of cpgen.
+//
+// Measures time of getWalkingPattern for each engine, and with step
+// adaptation driven by a perturbed measured CP every cycle. Each run is
+// repeated --reps times with the same inputs.
+//
+// The budget of the 1 kHz cycle is checked by the raw measurements (99.9th
+// percentile and max of all cycles of all repetitions), which include
+// preemption by the OS. Pin the benchmark by --cpu to a core isolated from
+// the scheduler (isolcpus) to see the real-time worst case. The minimum of
+// the repetitions for each cycle is also shown as the algorithmic cost
+// (mean, p99 and max), it removes preemption and is not checked.
+//
+// usage: cpgen_bench [--ticks N] [--seed S] [--reps N] [--cpu N]
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <streambuf>
+#include <random>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+
+#include <pthread.h>
+#include <sched.h>
+
+#include "cpgen.h"
+#include "tool_common.h"
+
+namespace {
+
+using namespace cp;
+using namespace cptool;
+
+const double budget_us = 1000.0;  // 1 kHz
+
+void initialize(cpgen* gen, double dt) {
+  Vector3 com(0.0, 0.0, 0.6);
+  Affine3d waist = Translation3(0.0, 0.0, 0.65) * Quat::Identity();
+  Affine3d legs[2] = {Translation3(0.0, -0.1, 0.0) * Quat::Identity(),
+                      Translation3(0.0,  0.1, 0.0) * Quat::Identity()};
+  Quat base2leg[2] = {Quat::Identity(), Quat::Identity()};
+  double end_cp_offset[2] = {0.0, 0.02};
+  gen->initialize(com, waist, legs, base2leg, end_cp_offset,
+                  dt, 0.5, 0.2, 0.6, 0.05);
+}
+
+// time of cycles over repetitions of a run
+class CycleTimes {
+ public:
+  explicit CycleTimes(long ticks) : us(ticks, 1e30), tick(0) {}
+  void rewind() {tick = 0;}
+  void add(double t) {
+    us[tick] = std::min(us[tick], t);
+    raw.push_back(t);
+    ++tick;
+  }
+  // @return: true if the raw max is in the budget
+  bool report(const char* name) {
+    long worst = std::max_element(us.begin(), us.end()) - us.begin();
+    double max = us[worst];
+    std::sort(us.begin(), us.end());
+    double sum = 0.0;
+    for (size_t i = 0; i < us.size(); ++i) sum += us[i];
+    double p99 = us[static_cast<size_t>(0.99 * (us.size() - 1))];
+    std::sort(raw.begin(), raw.end());
+    double raw_p999 = raw[static_cast<size_t>(0.999 * (raw.size() - 1))];
+    double raw_max = raw.back();
+    bool ok = raw_max < budget_us;
+    std::printf("%-22s raw p99.9 %8.3f us  max %8.3f us  %s\n", name,
+                raw_p999, raw_max, ok ? "OK" : "OVER BUDGET");
+    std::printf("%-22s min of reps: mean %7.3f us  p99 %7.3f us  max %7.3f us"
+                " (cycle %ld)\n", "", sum / us.size(), p99, max, worst);
+    return ok;
+  }
+
+ private:
+  std::vector<double> us;   // min of repetitions of each cycle
+  std::vector<double> raw;  // all measurements
+  long tick;
+};
+
+// @brief pin the calling thread to a core
+bool pinCPU(int cpu) {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+
+// @param adapt: use step adaptation with perturbed measured CP
+void runPattern(bool fast_slerp, size_t step_cache, bool adapt, long ticks,
+                unsigned seed, CycleTimes* times) {
+  const double dt = 1e-3;
+  cpgen gen;
+  initialize(&gen, dt);
+  gen.setFastSlerp(fast_slerp);
+  gen.setStepCache(step_cache);
+  StepAdaptParam sa = stepAdaptParam();
+  gen.setStepAdaptation(sa, adapt);
+
+  std::mt19937 rng(seed);
+  std::normal_distribution<double> noise(0.0, 0.005);
+  std::uniform_real_distribution<double> u(0.0, 1.0);
+  const double w = sqrt(9.806 / 0.6);
+  times->rewind();
+  WalkingPattern wp;
+  wp.com_pos << 0.0, 0.0, 0.6;
+  wp.com_vel.setZero();
+  gen.start();
+  for (long k = 0; k < ticks; ++k) {
+    if (gen.getWstate() == stopped) gen.start();
+    Vector3 land_pos(0.15, 0.0, 10.0);
+    if (adapt) {
+      Vector2 cp = (wp.com_pos + wp.com_vel / w).head<2>();
+      cp += Vector2(noise(rng), noise(rng));
+      if (u(rng) < 2e-3) cp += Vector2(0.05 * u(rng), 0.1 * u(rng) - 0.05);
+      gen.setMeasuredCP(cp);
+    }
+    gen.setLandPos(land_pos);
+    std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+    gen.getWalkingPattern(&wp);
+    std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+    times->add(std::chrono::duration<double, std::micro>(t1 - t0).count());
+  }
+}
+
+bool benchPattern(const char* name, bool fast_slerp, size_t step_cache,
+                  bool adapt, long ticks, unsigned seed, int reps) {
+  CycleTimes times(ticks);
+  for (int r = 0; r < reps; ++r) {
+    runPattern(fast_slerp, step_cache, adapt, ticks, seed, &times);
+  }
+  return times.report(name);
+}
+
+// worst case of the step adaptation solver alone
+void runSolver(long ticks, unsigned seed, CycleTimes* times) {
+  std::mt19937 rng(seed);
+  std::uniform_real_distribution<double> u(-1.0, 1.0);
+  CoMTrack comtrack;
+  comtrack.init_setup(1e-3, 0.5, 0.2, 0.6, Vector3(0.0, 0.0, 0.6));
+  comtrack.calcRefZMP(Vector2(0.1, 0.1));
+  StepAdaptParam sa = stepAdaptParam();
+  Matrix2 rot = Eigen::Rotation2Dd(0.3).toRotationMatrix();
+  Vector2 land_lo(-0.2, -0.1), land_hi(0.2, 0.15);
+  times->rewind();
+  double sink = 0.0;
+  for (long k = 0; k < ticks; ++k) {
+    Vector2 cp(0.1 + 0.2 * u(rng), 0.1 * u(rng));
+    Vector2 land, zmp, land_nom(0.2, 0.1 * u(rng)), end_cp(0.2, 0.0);
+    double tau;
+    std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+    sink += comtrack.solveStepAdapt(cp, land_nom, end_cp, rot, land_lo,
+                                    land_hi, 0.4, 0.1, 0.7, sa, &land, &zmp,
+                                    &tau);
+    std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+    times->add(std::chrono::duration<double, std::micro>(t1 - t0).count());
+  }
+  if (sink < 0.0) std::printf("%f\n", sink);
+}
+
+bool benchSolver(long ticks, unsigned seed, int reps) {
+  CycleTimes times(ticks);
+  for (int r = 0; r < reps; ++r) runSolver(ticks, seed, &times);
+  return times.report("step adaptation solve");
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  long ticks = 200000;
+  unsigned seed = 1;
+  int reps = 5;
+  int cpu = -1;
+  bool args_ok = parseOptions(argc, argv, [&](const char* o, const char* v) {
+    if (!std::strcmp(o, "--ticks")) ticks = std::atol(v);
+    else if (!std::strcmp(o, "--seed")) seed = std::atol(v);
+    else if (!std::strcmp(o, "--reps")) reps = std::max(1, std::atoi(v));
+    else if (!std::strcmp(o, "--cpu")) cpu = std::atoi(v);
+    else return false;
+    return true;
+  });
+  if (!args_ok) return 2;
+
+  if (cpu >= 0 && !pinCPU(cpu)) {
+    std::fprintf(stderr, "can not pin to cpu %d\n", cpu);
+    return 2;
+  }
+
+  // cpgen reports state changes to std::cout
+  NullBuffer null_buffer;
+  std::streambuf* cout_buffer = std::cout.rdbuf(&null_buffer);
+
+  std::printf("%ld cycles x %d repetitions, budget %.0f us, %s\n", ticks,
+              reps, budget_us, cpu >= 0 ? "pinned" : "not pinned (--cpu)");
+  bool ok = true;
+  ok &= benchPattern("reference", false, 0, false, ticks, seed, reps);
+  ok &= benchPattern("fast_slerp", true, 0, false, ticks, seed, reps);
+  ok &= benchPattern("step_cache", true, 8, false, ticks, seed, reps);
+  ok &= benchPattern("step_adaptation", true, 8, true, ticks, seed, reps);
+  ok &= benchSolver(ticks, seed, reps);
+  std::cout.rdbuf(cout_buffer);
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,340 @@
+// Conformance check of optimized paths against the reference cpgen.
+//
+// Randomized walks (setup parameters, initial pose and yaw, landing
+// positions, queued footsteps, turns, start/stop sequences, terrain and
+// step adaptation given by a seed) are run through the reference engine
+// and each alternative engine in lockstep, and max errors of each channel
+// of the walking pattern are compared with tolerances. Adapted walks give
+// all engines the same measured CP, of a LIPM plant driven by the
+// reference. Failing seeds are saved and can be replayed by --seed.
+//
+// usage: cpgen_conformance [--walks N] [--threads N] [--seed0 S]
+//                          [--seed S] [--pos-tol m] [--quat-tol rad]
+//                          [--deriv-tol x] [--fail-file path] [--map path]
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <streambuf>
+#include <random>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include <string>
+#include <algorithm>
+
+#include <unistd.h>
+
+#include "cpgen.h"
+#include "heightmap.h"
+#include "tool_common.h"
+
+namespace {
+
+using namespace cp;
+using namespace cptool;
+
+// engines to be compared. engines[0] is the reference, which calculates
+// the constants of every step in the cycle (setLegacyStep)
+struct Engine {
+  const char* name;
+  bool fast_slerp;
+  size_t step_cache;
+  bool legacy_step;
+};
+const Engine engines[] = {
+  {"reference",  false, 0, true},
+  {"fast_slerp", true,  0, false},
+  {"step_cache", true,  8, false},
+};
+const int engine_num = sizeof(engines) / sizeof(engines[0]);
+
+enum channel {
+  ch_com, ch_com_vel, ch_com_acc, ch_waist_q, ch_waist_w,
+  ch_r_leg_p, ch_r_leg_q, ch_r_leg_v, ch_r_leg_a,
+  ch_l_leg_p, ch_l_leg_q, ch_l_leg_v, ch_l_leg_a,
+  ch_ref_zmp, ch_ref_cp, ch_support, ch_wstate, channel_num
+};
+const char* channel_name[channel_num] = {
+  "com", "com_vel", "com_acc", "waist_q", "waist_w",
+  "r_leg_p", "r_leg_q", "r_leg_vel", "r_leg_acc",
+  "l_leg_p", "l_leg_q", "l_leg_vel", "l_leg_acc",
+  "ref_zmp", "ref_cp", "support", "wstate"
+};
+bool is_quat_channel(int c) {
+  return c == ch_waist_q || c == ch_r_leg_q || c == ch_l_leg_q;
+}
+// velocity and acceleration, which are larger than positions
+bool is_deriv_channel(int c) {
+  return c == ch_com_vel || c == ch_com_acc || c == ch_waist_w ||
+         c == ch_r_leg_v || c == ch_r_leg_a || c == ch_l_leg_v ||
+         c == ch_l_leg_a;
+}
+bool is_state_channel(int c) { return c == ch_support || c == ch_wstate; }
+
+struct Tolerance {
+  double pos, quat, deriv;
+  double of(int c) const {
+    if (is_state_channel(c)) return 0.0;
+    if (is_quat_channel(c)) return quat;
+    return is_deriv_channel(c) ? deriv : pos;
+  }
+};
+
+struct Result {
+  double err[engine_num][channel_num];
+  long ticks;
+  Result() : ticks(0) {
+    for (int e = 0; e < engine_num; ++e)
+      for (int c = 0; c < channel_num; ++c) err[e][c] = 0.0;
+  }
+  void merge(const Result& r) {
+    for (int e = 0; e < engine_num; ++e)
+      for (int c = 0; c < channel_num; ++c)
+        err[e][c] = std::max(err[e][c], r.err[e][c]);
+    ticks += r.ticks;
+  }
+};
+
+double quatError(const Quat& a, const Quat& b) {
+  Quat d = a.conjugate() * b;
+  return 2.0 * atan2(d.vec().norm(), std::abs(d.w()));
+}
+
+void maxError(double* err, const Vector3& a, const Vector3& b) {
+  *err = std::max(*err, (a - b).norm());
+}
+
+// @brief run a randomized walk by all engines in lockstep
+// @param seed: seed of the walk
+// @param map: terrain used by some walks
+// @param[out] r: max error of each engine and channel
+void runWalk(unsigned seed, const HeightMap* map, Result* r) {
+  std::mt19937 rng(seed);
+  std::uniform_real_distribution<double> u(0.0, 1.0);
+  const double dts[] = {1e-3, 2e-3, 5e-3};
+  double dt   = dts[rng() % 3];
+  double sst  = 0.3 + 0.5 * u(rng);
+  double dst  = 0.05 + 0.25 * u(rng);
+  double cogh = 0.5 + 0.4 * u(rng);
+  double legh = 0.02 + 0.06 * u(rng);
+  double foot_y = 0.06 + 0.06 * u(rng);
+  double end_cp_offset[2] = {0.03 * u(rng), 0.04 * u(rng)};
+  double yaw0 = 2.0 * PI * u(rng);
+  // terrain in half of walks, step adaptation in 30 %
+  if (u(rng) >= 0.5) map = NULL;
+  bool adapt = u(rng) < 0.3;
+
+  Quat waist_q = rpy2q(0.0, 0.0, yaw0);
+  Vector3 com(2.0 * u(rng) - 1.0, 2.0 * u(rng) - 1.0, cogh);
+  Affine3d legs[2] = {
+    Translation3(com + waist_q * Vector3(0.0, -foot_y, -cogh)) * waist_q,
+    Translation3(com + waist_q * Vector3(0.0,  foot_y, -cogh)) * waist_q};
+  for (int lr = 0; lr < 2; ++lr) {
+    Vector3 p = legs[lr].translation();
+    legs[lr].translation().z() = groundHeight(map, p.x(), p.y());
+  }
+  com.z() += 0.5 * (legs[0].translation().z() + legs[1].translation().z());
+  Affine3d waist = Translation3(com.x(), com.y(), com.z() + 0.05) * waist_q;
+  Quat base2leg[2] = {Quat::Identity(), Quat::Identity()};
+  FootGeometry sole = footGeometry();
+  StepAdaptParam sa = stepAdaptParam();
+
+  cpgen gen[engine_num];
+  for (int e = 0; e < engine_num; ++e) {
+    gen[e].initialize(com, waist, legs, base2leg, end_cp_offset,
+                      dt, sst, dst, cogh, legh);
+    gen[e].setFastSlerp(engines[e].fast_slerp);
+    gen[e].setStepCache(engines[e].step_cache);
+    gen[e].setLegacyStep(engines[e].legacy_step);
+    gen[e].setHeightMap(map, sole);
+    gen[e].setStepAdaptation(sa, adapt);
+    gen[e].start();
+  }
+  // LIPM plant which tracks the reference ZMP with CP feedback
+  // and gets a push now and then
+  Vector2 plant_cp = com.head<2>();
+
+  long ticks = static_cast<long>((5.0 + 15.0 * u(rng)) / dt);
+  long stop_ticks = static_cast<long>(30.0 / dt);
+  double p_cmd = dt / 0.3, p_stop = dt / 4.0, p_setup = dt / 5.0;
+  // footsteps are queued by pushStep in half of walks
+  bool queue = u(rng) < 0.5;
+  WalkingPattern wp[engine_num];
+  for (long k = 0; k < ticks + stop_ticks; ++k) {
+    // commands, same for all engines
+    bool ending = k >= ticks;
+    if (!ending && u(rng) < p_cmd) {
+      Vector3 lp(-0.1 + 0.35 * u(rng), -0.1 + 0.2 * u(rng),
+                 -30.0 + 60.0 * u(rng));
+      if (u(rng) < 0.2) lp = Vector3::Zero();
+      if (queue && gen[0].getQueuedSteps() < 4) {
+        StepSchedule sc = {0.3 + 0.5 * u(rng), 0.05 + 0.25 * u(rng),
+                           0.5 + 0.4 * u(rng), 0.02 + 0.06 * u(rng)};
+        for (int e = 0; e < engine_num; ++e) gen[e].pushStep(lp, sc);
+      } else {
+        for (int e = 0; e < engine_num; ++e) gen[e].setLandPos(lp);
+      }
+    }
+    if (!ending && u(rng) < p_setup) {
+      sst  = 0.3 + 0.5 * u(rng);
+      dst  = 0.05 + 0.25 * u(rng);
+      cogh = 0.5 + 0.4 * u(rng);
+      legh = 0.02 + 0.06 * u(rng);
+      for (int e = 0; e < engine_num; ++e)
+        gen[e].setup(dt, sst, dst, cogh, legh);
+    }
+    if (ending || u(rng) < p_stop) {
+      for (int e = 0; e < engine_num; ++e) gen[e].stop();
+    }
+    if (gen[0].getWstate() == stopped) {
+      if (ending) break;
+      if (u(rng) < 0.5) {
+        for (int e = 0; e < engine_num; ++e) gen[e].start();
+      }
+      continue;
+    }
+
+    for (int e = 0; e < engine_num; ++e) {
+      if (adapt) gen[e].setMeasuredCP(plant_cp);
+      gen[e].getWalkingPattern(&wp[e]);
+    }
+    ++r->ticks;
+    for (int e = 1; e < engine_num; ++e) {
+      double* err = r->err[e];
+      maxError(&err[ch_com], wp[e].com_pos, wp[0].com_pos);
+      maxError(&err[ch_com_vel], wp[e].com_vel, wp[0].com_vel);
+      maxError(&err[ch_com_acc], wp[e].com_acc, wp[0].com_acc);
+      err[ch_waist_q] = std::max(err[ch_waist_q], quatError(wp[e].waist_r, wp[0].waist_r));
+      maxError(&err[ch_waist_w], wp[e].waist_w, wp[0].waist_w);
+      for (int lr = 0; lr < 2; ++lr) {
+        int c = lr == right ? ch_r_leg_p : ch_l_leg_p;  // p, q, v, a
+        maxError(&err[c], wp[e].leg_pose[lr].p(), wp[0].leg_pose[lr].p());
+        err[c + 1] = std::max(err[c + 1], quatError(wp[e].leg_pose[lr].q(), wp[0].leg_pose[lr].q()));
+        maxError(&err[c + 2], wp[e].leg_vel[lr], wp[0].leg_vel[lr]);
+        maxError(&err[c + 3], wp[e].leg_acc[lr], wp[0].leg_acc[lr]);
+      }
+      err[ch_ref_zmp] = std::max(err[ch_ref_zmp], (wp[e].ref_zmp - wp[0].ref_zmp).norm());
+      err[ch_ref_cp] = std::max(err[ch_ref_cp], (wp[e].ref_cp - wp[0].ref_cp).norm());
+      if (wp[e].support != wp[0].support) err[ch_support] = 1.0;
+      if (gen[e].getWstate() != gen[0].getWstate()) err[ch_wstate] = 1.0;
+    }
+    if (adapt) {
+      if (u(rng) < dt) plant_cp += Vector2(0.06 * (u(rng) - 0.5), 0.06 * (u(rng) - 0.5));
+      double w = sqrt(9.806 / cogh);
+      Vector2 zmp = wp[0].ref_zmp + 2.0 * (plant_cp - wp[0].ref_cp);
+      plant_cp = zmp + exp(w * dt) * (plant_cp - zmp);
+    }
+  }
+}
+
+bool isPass(const Result& r, const Tolerance& tol) {
+  for (int e = 1; e < engine_num; ++e) {
+    for (int c = 0; c < channel_num; ++c) {
+      if (!(r.err[e][c] <= tol.of(c))) return false;  // NaN fails
+    }
+  }
+  return true;
+}
+
+void printResult(const Result& r, const Tolerance& tol) {
+  std::printf("%-12s", "channel");
+  for (int e = 1; e < engine_num; ++e) std::printf(" %14s", engines[e].name);
+  std::printf(" %10s\n", "tolerance");
+  for (int c = 0; c < channel_num; ++c) {
+    std::printf("%-12s", channel_name[c]);
+    for (int e = 1; e < engine_num; ++e) {
+      std::printf(" %13.3e%s", r.err[e][c], r.err[e][c] <= tol.of(c) ? " " : "*");
+    }
+    std::printf(" %10.1e\n", tol.of(c));
+  }
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  long walks = 2000;
+  unsigned seed0 = 1;
+  long replay = -1;
+  unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+  Tolerance tol = {1e-9, 1e-9, 1e-6};
+  std::string fail_file = "cpgen_conformance_fail.txt";
+  std::string map_file = "cpgen_conformance_map.bin";
+  bool args_ok = parseOptions(argc, argv, [&](const char* o, const char* v) {
+    if (!std::strcmp(o, "--walks")) walks = std::atol(v);
+    else if (!std::strcmp(o, "--threads")) threads = std::atoi(v);
+    else if (!std::strcmp(o, "--seed0")) seed0 = std::atol(v);
+    else if (!std::strcmp(o, "--seed")) replay = std::atol(v);
+    else if (!std::strcmp(o, "--pos-tol")) tol.pos = std::atof(v);
+    else if (!std::strcmp(o, "--quat-tol")) tol.quat = std::atof(v);
+    else if (!std::strcmp(o, "--deriv-tol")) tol.deriv = std::atof(v);
+    else if (!std::strcmp(o, "--fail-file")) fail_file = v;
+    else if (!std::strcmp(o, "--map")) map_file = v;
+    else return false;
+    return true;
+  });
+  if (!args_ok) return 2;
+
+  // the terrain is shared by all walks. it stays mapped after unlink
+  HeightMap map;
+  if (!writeTerrain(map_file.c_str()) || !map.open(map_file.c_str())) {
+    std::fprintf(stderr, "can not make terrain %s\n", map_file.c_str());
+    return 2;
+  }
+  unlink(map_file.c_str());
+
+  // cpgen reports state changes to std::cout
+  NullBuffer null_buffer;
+  std::streambuf* cout_buffer = std::cout.rdbuf(&null_buffer);
+
+  if (replay >= 0) {
+    Result r;
+    runWalk(static_cast<unsigned>(replay), &map, &r);
+    std::cout.rdbuf(cout_buffer);
+    std::printf("seed %ld: %ld ticks\n", replay, r.ticks);
+    printResult(r, tol);
+    return isPass(r, tol) ? 0 : 1;
+  }
+
+  Result total;
+  std::vector<unsigned> failed;
+  std::mutex mtx;
+  std::atomic<long> next(0);
+  std::vector<std::thread> workers;
+  for (unsigned t = 0; t < threads; ++t) {
+    workers.push_back(std::thread([&]() {
+      Result local;
+      std::vector<unsigned> local_failed;
+      for (long i = next++; i < walks; i = next++) {
+        unsigned seed = seed0 + static_cast<unsigned>(i);
+        Result r;
+        runWalk(seed, &map, &r);
+        if (!isPass(r, tol)) local_failed.push_back(seed);
+        local.merge(r);
+      }
+      std::lock_guard<std::mutex> lock(mtx);
+      total.merge(local);
+      failed.insert(failed.end(), local_failed.begin(), local_failed.end());
+    }));
+  }
+  for (size_t t = 0; t < workers.size(); ++t) workers[t].join();
+  std::cout.rdbuf(cout_buffer);
+
+  std::printf("%ld walks, %ld ticks, %u threads\n", walks, total.ticks, threads);
+  printResult(total, tol);
+  if (failed.empty()) {
+    std::printf("PASS\n");
+    return 0;
+  }
+  std::sort(failed.begin(), failed.end());
+  FILE* fp = std::fopen(fail_file.c_str(), "w");
+  if (fp) {
+    for (size_t i = 0; i < failed.size(); ++i) std::fprintf(fp, "%u\n", failed[i]);
+    std::fclose(fp);
+  }
+  std::printf("FAIL: %zu walks, seeds are saved to %s (replay by --seed)\n",
+              failed.size(), fail_file.c_str());
+  return 1;
+}
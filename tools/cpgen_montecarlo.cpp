@@ -0,0 +1,307 @@
+// Monte Carlo robustness evaluation of cpgen under modelling error.
+//
+// Each walk rolls the walking pattern out against a LIPM plant whose CoM
+// height differs from the pattern, which tracks the reference ZMP (with
+// CP feedback) after a delay, gets a push impulse and lands the feet with
+// position noise. ZMP of the plant is limited to the support polygon of
+// the landed feet. A walk falls when the CP of the plant is more than
+// --fall-dist out of the support polygon, where the next step can not
+// catch it. Walks run in parallel and only compact statistics (falls,
+// distribution of max CP error from the reference) are kept, no
+// trajectory is stored.
+//
+// usage: cpgen_montecarlo [--walks N] [--threads N] [--seed0 S] [--seed S]
+//                         [--time s] [--dt s] [--h-err ratio]
+//                         [--delay s] [--push m/s] [--land-noise m]
+//                         [--gain k] [--fall-dist m] [--adapt 0|1]
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <streambuf>
+#include <random>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+
+#include "cpgen.h"
+#include "support_polygon.h"
+#include "tool_common.h"
+
+namespace {
+
+using namespace cp;
+using namespace cptool;
+
+struct Option {
+  double time;        // walking time before stop [s]
+  double dt;          // sampling time [s]
+  double h_err;       // std of CoM height error (ratio)
+  double delay;       // max tracking delay [s]
+  double push;        // max push impulse [m/s]
+  double land_noise;  // std of landing position error [m]
+  double gain;        // CP feedback gain of the plant
+  double fall_dist;   // CP out of support polygon of a fall [m]
+  bool adapt;         // step adaptation by CP of the plant
+};
+
+// histogram of max CP error
+const int hist_bins = 50;
+const double hist_max = 0.2;  // [m]
+
+// result of a walk
+struct WalkResult {
+  bool fall;
+  double max_cp_err;  // [m]
+  long ticks;
+  long saturated;     // ticks of ZMP limited by support polygon
+};
+
+// streamed statistics of walks
+struct Summary {
+  long walks, falls, ticks, saturated;
+  double sum_err, max_err;
+  unsigned worst_seed;
+  long hist[hist_bins + 1];  // last bin: over hist_max
+  Summary() : walks(0), falls(0), ticks(0), saturated(0), sum_err(0.0),
+              max_err(0.0), worst_seed(0) {
+    for (int i = 0; i <= hist_bins; ++i) hist[i] = 0;
+  }
+  void add(unsigned seed, const WalkResult& r) {
+    ++walks;
+    ticks += r.ticks;
+    saturated += r.saturated;
+    sum_err += r.max_cp_err;
+    if (r.max_cp_err > max_err || walks == 1) {
+      max_err = r.max_cp_err;
+      worst_seed = seed;
+    }
+    if (r.fall) ++falls;
+    int b = static_cast<int>(r.max_cp_err / hist_max * hist_bins);
+    ++hist[std::min(b, hist_bins)];
+  }
+  void merge(const Summary& s) {
+    if (s.walks > 0 && (s.max_err > max_err || walks == 0)) {
+      max_err = s.max_err;
+      worst_seed = s.worst_seed;
+    }
+    walks += s.walks;
+    falls += s.falls;
+    ticks += s.ticks;
+    saturated += s.saturated;
+    sum_err += s.sum_err;
+    for (int i = 0; i <= hist_bins; ++i) hist[i] += s.hist[i];
+  }
+  // upper edge of the bin of quantile q [m], -1 if over hist_max
+  double quantile(double q) const {
+    long n = static_cast<long>(q * (walks - 1));
+    long c = 0;
+    for (int i = 0; i < hist_bins; ++i) {
+      c += hist[i];
+      if (c > n) return hist_max * (i + 1) / hist_bins;
+    }
+    return -1.0;
+  }
+};
+
+// @brief ZMP limited to the support polygon on the line from inside point
+Vector2 limitZMP(const SupportPolygon& sp, const Vector2& inside,
+                 const Vector2& zmp) {
+  Vector2 a = inside, b = zmp;
+  for (int i = 0; i < 12; ++i) {
+    Vector2 m = (a + b) * 0.5;
+    if (sp.getMargin(m) >= 0.0) a = m;
+    else b = m;
+  }
+  return a;
+}
+
+// @brief walk against perturbed LIPM plant
+// @param seed: seed of the walk
+// @param verbose: print the sampled error and state of the walk
+WalkResult runWalk(unsigned seed, const Option& op, bool verbose) {
+  std::mt19937 rng(seed);
+  std::uniform_real_distribution<double> u(0.0, 1.0);
+  std::normal_distribution<double> n(0.0, 1.0);
+  const double dt = op.dt, cogh = 0.6, g = 9.806;
+
+  // pattern
+  Vector3 com(0.0, 0.0, cogh);
+  Affine3d waist = Translation3(0.0, 0.0, cogh + 0.05) * Quat::Identity();
+  Affine3d legs[2] = {Translation3(0.0, -0.1, 0.0) * Quat::Identity(),
+                      Translation3(0.0,  0.1, 0.0) * Quat::Identity()};
+  Quat base2leg[2] = {Quat::Identity(), Quat::Identity()};
+  double end_cp_offset[2] = {0.0, 0.02};
+  cpgen gen;
+  gen.initialize(com, waist, legs, base2leg, end_cp_offset,
+                 dt, 0.5, 0.2, cogh, 0.05);
+  StepAdaptParam sa = stepAdaptParam();
+  gen.setStepAdaptation(sa, op.adapt);
+  Vector3 step(0.15 * u(rng), 0.04 * u(rng) - 0.02, 20.0 * u(rng) - 10.0);
+
+  // plant
+  double h = std::max(0.3, cogh * (1.0 + op.h_err * n(rng)));
+  double w = sqrt(g / h);
+  double a_cp = exp(w * dt);
+  int delay = static_cast<int>(op.delay / dt * u(rng));
+  std::vector<Vector2> zmp_buf(delay + 1, com.head<2>());
+  long push_tick = static_cast<long>((0.5 + (op.time - 0.5) * u(rng)) / dt);
+  double push_dir = 2.0 * PI * u(rng);
+  Vector2 push = op.push * u(rng) * Vector2(cos(push_dir), sin(push_dir));
+  FootGeometry fg = footGeometry();
+  SupportPolygon sp;
+  sp.setup(fg);
+  Vector3 land_err[2] = {Vector3::Zero(), Vector3::Zero()};
+  if (verbose) {
+    std::printf("height %.3f m, delay %d ticks, push %.3f %.3f m/s at %ld, "
+                "step %.3f %.3f %.1f\n", h, delay, push.x(), push.y(),
+                push_tick, step.x(), step.y(), step.z());
+  }
+
+  // the fall and the error are of CP, CoM of the plant is not needed
+  Vector2 plant_cp = com.head<2>();
+  WalkResult r = {false, 0.0, 0, 0};
+  WalkingPattern wp;
+  rl support = both;
+  long walk_ticks = static_cast<long>(op.time / dt);
+  long end_ticks = walk_ticks + static_cast<long>(10.0 / dt);
+  gen.start();
+  for (long k = 0; gen.getWstate() != stopped && k < end_ticks; ++k) {
+    if (gen.isStepBoundary()) {
+      if (k >= walk_ticks) {
+        gen.setLandPos(Vector3::Zero());
+        gen.stop();
+      } else {
+        gen.setLandPos(step);
+      }
+      land_err[gen.getSwingleg()] << op.land_noise * n(rng),
+                                     op.land_noise * n(rng), 0.0;
+    }
+    if (op.adapt) gen.setMeasuredCP(plant_cp);
+    gen.getWalkingPattern(&wp);
+    ++r.ticks;
+
+    // support polygon of landed feet
+    if (wp.support != support || wp.support != both) {
+      Pose feet[2];
+      for (int lr = 0; lr < 2; ++lr) {
+        feet[lr].set(wp.leg_pose[lr].p() + land_err[lr], wp.leg_pose[lr].q());
+      }
+      sp.update(feet, wp.support);
+      support = wp.support;
+    }
+
+    // delayed ZMP tracking with CP feedback
+    Vector2 zmp_cmd = wp.ref_zmp + op.gain * (plant_cp - wp.ref_cp);
+    zmp_buf[k % zmp_buf.size()] = zmp_cmd;
+    Vector2 zmp = zmp_buf[(k + 1) % zmp_buf.size()];
+    if (sp.getMargin(zmp) < 0.0) {
+      Vector2 c = Vector2::Zero();
+      for (int i = 0; i < sp.size(); ++i) c += sp.vertex(i);
+      zmp = limitZMP(sp, c / sp.size(), zmp);
+      ++r.saturated;
+    }
+
+    // LIPM
+    if (k == push_tick) plant_cp += push / w;
+    plant_cp = zmp + a_cp * (plant_cp - zmp);
+
+    r.max_cp_err = std::max(r.max_cp_err, (plant_cp - wp.ref_cp).norm());
+    double out = -sp.getMargin(plant_cp);
+    if (!(out < op.fall_dist)) {
+      r.fall = true;
+      if (verbose) {
+        std::printf("fall at tick %ld, cp is %.4f m out of support polygon\n",
+                    k, out);
+      }
+      break;
+    }
+  }
+  return r;
+}
+
+void printSummary(const Summary& s, double sec, unsigned threads) {
+  std::printf("%ld walks, %ld ticks, %u threads, %.2f s\n",
+              s.walks, s.ticks, threads, sec);
+  std::printf("%.0f walks/s, %.0f walks/s/thread\n",
+              s.walks / sec, s.walks / sec / threads);
+  std::printf("falls %ld (%.3f %%)\n", s.falls, 100.0 * s.falls / s.walks);
+  std::printf("max cp error: mean %.4f m, max %.4f m (seed %u)\n",
+              s.sum_err / s.walks, s.max_err, s.worst_seed);
+  const double q[] = {0.5, 0.9, 0.99};
+  for (int i = 0; i < 3; ++i) {
+    double v = s.quantile(q[i]);
+    if (v < 0.0) std::printf("  p%-3g > %.4f m\n", 100.0 * q[i], hist_max);
+    else std::printf("  p%-3g < %.4f m\n", 100.0 * q[i], v);
+  }
+  std::printf("zmp limited by support polygon: %.3f %% of ticks\n",
+              100.0 * s.saturated / s.ticks);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  long walks = 10000;
+  unsigned seed0 = 1;
+  long replay = -1;
+  unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+  Option op = {5.0, 5e-3, 0.05, 0.02, 0.3, 0.01, 2.0, 0.3, false};
+  bool args_ok = parseOptions(argc, argv, [&](const char* o, const char* v) {
+    if (!std::strcmp(o, "--walks")) walks = std::atol(v);
+    else if (!std::strcmp(o, "--threads")) threads = std::atoi(v);
+    else if (!std::strcmp(o, "--seed0")) seed0 = std::atol(v);
+    else if (!std::strcmp(o, "--seed")) replay = std::atol(v);
+    else if (!std::strcmp(o, "--time")) op.time = std::atof(v);
+    else if (!std::strcmp(o, "--dt")) op.dt = std::atof(v);
+    else if (!std::strcmp(o, "--h-err")) op.h_err = std::atof(v);
+    else if (!std::strcmp(o, "--delay")) op.delay = std::atof(v);
+    else if (!std::strcmp(o, "--push")) op.push = std::atof(v);
+    else if (!std::strcmp(o, "--land-noise")) op.land_noise = std::atof(v);
+    else if (!std::strcmp(o, "--gain")) op.gain = std::atof(v);
+    else if (!std::strcmp(o, "--fall-dist")) op.fall_dist = std::atof(v);
+    else if (!std::strcmp(o, "--adapt")) op.adapt = std::atoi(v) != 0;
+    else return false;
+    return true;
+  });
+  if (!args_ok) return 2;
+
+  // cpgen reports state changes to std::cout
+  NullBuffer null_buffer;
+  std::streambuf* cout_buffer = std::cout.rdbuf(&null_buffer);
+
+  if (replay >= 0) {
+    WalkResult r = runWalk(static_cast<unsigned>(replay), op, true);
+    std::cout.rdbuf(cout_buffer);
+    std::printf("seed %ld: %ld ticks, max cp error %.4f m, %s\n", replay,
+                r.ticks, r.max_cp_err, r.fall ? "FALL" : "ok");
+    return r.fall ? 1 : 0;
+  }
+
+  Summary total;
+  std::mutex mtx;
+  std::atomic<long> next(0);
+  std::vector<std::thread> workers;
+  std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+  for (unsigned t = 0; t < threads; ++t) {
+    workers.push_back(std::thread([&]() {
+      Summary local;
+      for (long i = next++; i < walks; i = next++) {
+        unsigned seed = seed0 + static_cast<unsigned>(i);
+        local.add(seed, runWalk(seed, op, false));
+      }
+      std::lock_guard<std::mutex> lock(mtx);
+      total.merge(local);
+    }));
+  }
+  for (size_t t = 0; t < workers.size(); ++t) workers[t].join();
+  double sec = std::chrono::duration<double>(
+                   std::chrono::steady_clock::now() - t0).count();
+  std::cout.rdbuf(cout_buffer);
+
+  printSummary(total, sec, threads);
+  return 0;
+}
@@ -0,0 +1,442 @@
+// Randomized stress test of the walking state machine.
+//
+// Many independent generators are driven on all cores by commands
+// (start, stop, estop, setLandPos, setup, pushStep, clearSteps) issued at
+// random cycles, including bursts of several commands in a cycle. Each run
+// starts from a random position and yaw, and some runs also walk on a
+// random terrain, adapt steps to a noisy measured CP or use the reference
+// slerp. Every cycle is checked against invariants, and each run must come
+// to stopped after the commands end. Failing seeds are saved and can be
+// replayed by --seed, which prints the first violation.
+//
+// invariants:
+//   finite      no NaN or inf in the walking pattern
+//   jump        CoM, legs and waist move as far as their velocities allow
+//               in a cycle (plus a bounded acceleration), and not faster
+//               than the limits
+//   diverge     CoM stays near CP, CP stays near the feet
+//   stop        state is stopped within --stop-time after the commands
+//
+// usage: cpgen_stress [--runs N] [--time s] [--threads N] [--seed0 S]
+//                     [--seed S] [--stop-time s] [--fail-file path]
+//                     [--map path]
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <streambuf>
+#include <random>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <algorithm>
+
+#include <unistd.h>
+
+#include "cpgen.h"
+#include "heightmap.h"
+#include "tool_common.h"
+
+namespace {
+
+using namespace cp;
+using namespace cptool;
+
+// limits of invariants
+const double max_com_vel = 5.0;     // CoM [m/s]
+const double max_leg_vel = 10.0;    // legs, adapted swing is fast [m/s]
+const double max_lin_acc = 300.0;   // CoM and legs [m/s^2]
+const double max_ang_vel = 20.0;    // waist and legs [rad/s]
+const double max_ang_acc = 3000.0;  // waist [rad/s^2]
+const double max_com_cp = 0.5;      // CoM from CP [m]
+const double max_cp_feet = 1.0;     // CP from the middle of feet [m]
+
+enum violation {
+  ok, v_finite, v_jump, v_diverge, v_stop, violation_num
+};
+const char* violation_name[violation_num] = {
+  "ok", "finite", "jump", "diverge", "stop"
+};
+
+struct Failure {
+  unsigned seed;
+  violation v;
+  long tick;
+  std::string what;
+};
+
+struct Stats {
+  long runs, ticks, commands;
+  long count[violation_num];
+  Stats() : runs(0), ticks(0), commands(0) {
+    for (int i = 0; i < violation_num; ++i) count[i] = 0;
+  }
+  void merge(const Stats& s) {
+    runs += s.runs;
+    ticks += s.ticks;
+    commands += s.commands;
+    for (int i = 0; i < violation_num; ++i) count[i] += s.count[i];
+  }
+};
+
+double quatAngle(const Quat& a, const Quat& b) {
+  Quat d = a.conjugate() * b;
+  return 2.0 * atan2(d.vec().norm(), std::abs(d.w()));
+}
+
+bool isFinite(const WalkingPattern& wp) {
+  bool f = wp.com_pos.allFinite() && wp.com_vel.allFinite() &&
+           wp.com_acc.allFinite() && wp.waist_r.coeffs().allFinite() &&
+           wp.waist_w.allFinite() && wp.ref_zmp.allFinite() &&
+           wp.ref_cp.allFinite();
+  for (int lr = 0; lr < 2; ++lr) {
+    f = f && wp.leg_pose[lr].p().allFinite() &&
+        wp.leg_pose[lr].q().coeffs().allFinite() &&
+        wp.leg_vel[lr].allFinite() && wp.leg_acc[lr].allFinite();
+  }
+  return f;
+}
+
+// @brief check invariants of a cycle
+// @param prev: pattern of the cycle before, NULL at the first cycle
+// @param[out] what: description of violation
+violation check(const WalkingPattern& wp, const WalkingPattern* prev,
+                double dt, std::string* what) {
+  char buf[128];
+  if (!isFinite(wp)) {
+    *what = "NaN or inf in walking pattern";
+    return v_finite;
+  }
+  if (prev) {
+    // a move beyond the velocities of both cycles is a snap
+    double acc = 0.5 * max_lin_acc * dt * dt + 1e-9;
+    double d = (wp.com_pos - prev->com_pos).norm();
+    double v = std::max(wp.com_vel.norm(), prev->com_vel.norm());
+    if (v > max_com_vel || d > v * dt + acc) {
+      std::snprintf(buf, sizeof(buf), "com moved %.4f m at %.3f m/s", d, v);
+      *what = buf;
+      return v_jump;
+    }
+    d = quatAngle(wp.waist_r, prev->waist_r);
+    v = std::max(wp.waist_w.norm(), prev->waist_w.norm());
+    if (v > max_ang_vel || d > v * dt + 0.5 * max_ang_acc * dt * dt + 1e-9) {
+      std::snprintf(buf, sizeof(buf), "waist turned %.4f rad at %.3f rad/s",
+                    d, v);
+      *what = buf;
+      return v_jump;
+    }
+    for (int lr = 0; lr < 2; ++lr) {
+      d = (wp.leg_pose[lr].p() - prev->leg_pose[lr].p()).norm();
+      v = std::max(wp.leg_vel[lr].norm(), prev->leg_vel[lr].norm());
+      if (v > max_leg_vel || d > v * dt + acc) {
+        std::snprintf(buf, sizeof(buf), "%s leg moved %.4f m at %.3f m/s",
+                      lr == right ? "right" : "left", d, v);
+        *what = buf;
+        return v_jump;
+      }
+      // angular velocity of legs is not in the pattern
+      d = quatAngle(wp.leg_pose[lr].q(), prev->leg_pose[lr].q());
+      if (d > max_ang_vel * dt + 1e-9) {
+        std::snprintf(buf, sizeof(buf), "%s leg turned %.4f rad",
+                      lr == right ? "right" : "left", d);
+        *what = buf;
+        return v_jump;
+      }
+    }
+  }
+  double d = (wp.com_pos.head<2>() - wp.ref_cp).norm();
+  if (d > max_com_cp) {
+    std::snprintf(buf, sizeof(buf), "com is %.4f m from cp", d);
+    *what = buf;
+    return v_diverge;
+  }
+  Vector3 mid = (wp.leg_pose[right].p() + wp.leg_pose[left].p()) * 0.5;
+  d = (wp.ref_cp - mid.head<2>()).norm();
+  if (d > max_cp_feet) {
+    std::snprintf(buf, sizeof(buf), "cp is %.4f m from feet", d);
+    *what = buf;
+    return v_diverge;
+  }
+  return ok;
+}
+
+Vector3 randomLandPos(std::mt19937& rng) {
+  std::uniform_real_distribution<double> u(0.0, 1.0);
+  if (u(rng) < 0.2) return Vector3::Zero();
+  return Vector3(-0.1 + 0.35 * u(rng), -0.1 + 0.2 * u(rng),
+                 -30.0 + 60.0 * u(rng));
+}
+
+// @brief run a generator with random commands and check invariants
+// @param seed: seed of the run
+// @param cmd_time: time of random commands [s]
+// @param stop_time: max time to stop after the commands [s]
+// @param map: terrain used by some runs (NULL: flat only)
+// @param verbose: print commands and the first violation
+// @param[out] s: number of ticks and commands
+// @param[out] f: first violation
+// @return: false if an invariant is violated
+bool runStress(unsigned seed, double cmd_time, double stop_time,
+               const HeightMap* map, bool verbose, Stats* s, Failure* f) {
+  std::mt19937 rng(seed);
+  std::uniform_real_distribution<double> u(0.0, 1.0);
+  const double dts[] = {1e-3, 2e-3, 5e-3};
+  double dt   = dts[rng() % 3];
+  double sst  = 0.3 + 0.5 * u(rng);
+  double dst  = 0.05 + 0.25 * u(rng);
+  double cogh = 0.5 + 0.4 * u(rng);
+  double legh = 0.02 + 0.06 * u(rng);
+  double foot_y = 0.06 + 0.06 * u(rng);
+  double end_cp_offset[2] = {0.03 * u(rng), 0.04 * u(rng)};
+  Vector3 p0(-1.0 + 2.0 * u(rng), -1.0 + 2.0 * u(rng), 0.0);
+  double yaw = PI * (2.0 * u(rng) - 1.0);
+  if (u(rng) >= 0.5) map = NULL;
+  bool adapt = u(rng) < 0.3;
+  bool fast_slerp = u(rng) >= 0.2;
+  if (verbose) {
+    std::printf("start %.3f %.3f %.1f map %d adapt %d fast_slerp %d\n",
+                p0.x(), p0.y(), rad2deg(yaw), map != NULL, adapt, fast_slerp);
+  }
+
+  Quat q0(AngleAxisd(yaw, Vector3::UnitZ()));
+  Vector3 foot[2];
+  for (int lr = 0; lr < 2; ++lr) {
+    foot[lr] = p0 + q0 * Vector3(0.0, lr == right ? -foot_y : foot_y, 0.0);
+    foot[lr].z() = groundHeight(map, foot[lr].x(), foot[lr].y());
+  }
+  double z0 = 0.5 * (foot[right].z() + foot[left].z());
+  Vector3 com(p0.x(), p0.y(), z0 + cogh);
+  Affine3d waist = Translation3(com + Vector3(0.0, 0.0, 0.05)) * q0;
+  Affine3d legs[2] = {Translation3(foot[right]) * q0,
+                      Translation3(foot[left]) * q0};
+  Quat base2leg[2] = {Quat::Identity(), Quat::Identity()};
+  cpgen gen;
+  gen.initialize(com, waist, legs, base2leg, end_cp_offset,
+                 dt, sst, dst, cogh, legh);
+  FootGeometry sole = footGeometry();
+  gen.setHeightMap(map, sole);
+  gen.setFastSlerp(fast_slerp);
+  StepAdaptParam sa = stepAdaptParam();
+  gen.setStepAdaptation(sa, adapt);
+  // measured CP is of a LIPM plant which tracks the reference ZMP with
+  // CP feedback, gets a push now and then and is measured with noise
+  std::normal_distribution<double> noise(0.0, 0.002);
+  Vector2 plant_cp = com.head<2>();
+
+  f->seed = seed;
+  f->v = ok;
+  ++s->runs;
+  long cmd_ticks = static_cast<long>(cmd_time / dt);
+  long end_ticks = cmd_ticks + static_cast<long>(stop_time / dt);
+  // commands per cycle: mostly none, sometimes a burst
+  double p_cmd = std::min(1.0, dt / 0.05);
+  WalkingPattern wp, prev;
+  bool has_prev = false;
+  walking_state ws = stopped;
+  for (long k = 0; k < end_ticks; ++k) {
+    if (verbose && gen.getWstate() != ws) {
+      ws = gen.getWstate();
+      std::printf("%ld state %d\n", k, ws);
+    }
+    if (k < cmd_ticks) {
+      int n = u(rng) < p_cmd ? 1 + static_cast<int>(rng() % 3) : 0;
+      for (int i = 0; i < n; ++i) {
+        int c = rng() % 100;
+        ++s->commands;
+        if (c < 25) {
+          gen.start();
+          if (verbose) std::printf("%ld start\n", k);
+        } else if (c < 40) {
+          gen.stop();
+          if (verbose) std::printf("%ld stop\n", k);
+        } else if (c < 42) {
+          gen.estop();
+          if (verbose) std::printf("%ld estop\n", k);
+        } else if (c < 70) {
+          Vector3 lp = randomLandPos(rng);
+          gen.setLandPos(lp);
+          if (verbose) std::printf("%ld setLandPos %.3f %.3f %.1f\n",
+                                   k, lp.x(), lp.y(), lp.z());
+        } else if (c < 80) {
+          sst  = 0.3 + 0.5 * u(rng);
+          dst  = 0.05 + 0.25 * u(rng);
+          cogh = 0.5 + 0.4 * u(rng);
+          legh = 0.02 + 0.06 * u(rng);
+          gen.setup(dt, sst, dst, cogh, legh);
+          if (verbose) std::printf("%ld setup %.3f %.3f %.3f %.3f\n",
+                                   k, sst, dst, cogh, legh);
+        } else if (c < 97) {
+          Vector3 lp = randomLandPos(rng);
+          StepSchedule sc = {0.3 + 0.5 * u(rng), 0.05 + 0.25 * u(rng),
+                             0.5 + 0.4 * u(rng), 0.02 + 0.06 * u(rng)};
+          gen.pushStep(lp, sc);
+          if (verbose) std::printf("%ld pushStep %.3f %.3f %.1f\n",
+                                   k, lp.x(), lp.y(), lp.z());
+        } else {
+          gen.clearSteps();
+          if (verbose) std::printf("%ld clearSteps\n", k);
+        }
+      }
+    } else {
+      // put the feet together and stop
+      gen.clearSteps();
+      gen.setLandPos(Vector3::Zero());
+      gen.stop();
+    }
+
+    if (gen.getWstate() == stopped) {
+      if (k >= cmd_ticks) return true;
+      continue;
+    }
+    if (adapt) {
+      gen.setMeasuredCP(plant_cp + Vector2(noise(rng), noise(rng)));
+    }
+    gen.getWalkingPattern(&wp);
+    ++s->ticks;
+    violation v = check(wp, has_prev ? &prev : NULL, dt, &f->what);
+    if (v != ok) {
+      f->v = v;
+      f->tick = k;
+      ++s->count[v];
+      return false;
+    }
+    if (adapt) {
+      if (u(rng) < dt) {
+        Vector2 push(u(rng) - 0.5, u(rng) - 0.5);
+        plant_cp += 0.06 * push;
+        if (verbose) std::printf("%ld push %.3f %.3f\n", k, 0.06 * push.x(),
+                                 0.06 * push.y());
+      }
+      double w = sqrt(9.806 / cogh);
+      Vector2 zmp = wp.ref_zmp + 2.0 * (plant_cp - wp.ref_cp);
+      plant_cp = zmp + exp(w * dt) * (plant_cp - zmp);
+    }
+    prev = wp;
+    has_prev = true;
+  }
+  f->v = v_stop;
+  f->tick = end_ticks;
+  f->what = "not stopped";
+  ++s->count[v_stop];
+  return false;
+}
+
+void printStats(const Stats& s, double sec, unsigned threads) {
+  std::printf("%ld runs, %ld ticks, %ld commands, %u threads, %.2f s\n",
+              s.runs, s.ticks, s.commands, threads, sec);
+  std::printf("%.3e commands/s, %.3e ticks/s\n",
+              s.commands / sec, s.ticks / sec);
+  for (int i = 1; i < violation_num; ++i) {
+    std::printf("%-8s %ld\n", violation_name[i], s.count[i]);
+  }
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  long runs = 20000;
+  double cmd_time = 20.0, stop_time = 20.0;
+  unsigned seed0 = 1;
+  long replay = -1;
+  unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+  std::string fail_file = "cpgen_stress_fail.txt";
+  std::string map_file = "cpgen_stress_map.bin";
+  bool args_ok = parseOptions(argc, argv, [&](const char* o, const char* v) {
+    if (!std::strcmp(o, "--runs")) runs = std::atol(v);
+    else if (!std::strcmp(o, "--time")) cmd_time = std::atof(v);
+    else if (!std::strcmp(o, "--threads")) threads = std::atoi(v);
+    else if (!std::strcmp(o, "--seed0")) seed0 = std::atol(v);
+    else if (!std::strcmp(o, "--seed")) replay = std::atol(v);
+    else if (!std::strcmp(o, "--stop-time")) stop_time = std::atof(v);
+    else if (!std::strcmp(o, "--fail-file")) fail_file = v;
+    else if (!std::strcmp(o, "--map")) map_file = v;
+    else return false;
+    return true;
+  });
+  if (!args_ok) return 2;
+
+  // the terrain is shared by all runs. it stays mapped after unlink
+  HeightMap map;
+  if (!writeTerrain(map_file.c_str()) || !map.open(map_file.c_str())) {
+    std::fprintf(stderr, "can not make terrain %s\n", map_file.c_str());
+    return 2;
+  }
+  unlink(map_file.c_str());
+
+  // cpgen reports state changes to std::cout
+  NullBuffer null_buffer;
+  std::streambuf* cout_buffer = std::cout.rdbuf(&null_buffer);
+
+  if (replay >= 0) {
+    Stats s;
+    Failure f;
+    bool pass = runStress(static_cast<unsigned>(replay), cmd_time, stop_time,
+                          &map, true, &s, &f);
+    std::cout.rdbuf(cout_buffer);
+    std::printf("seed %ld: %ld ticks, %ld commands\n", replay, s.ticks,
+                s.commands);
+    if (pass) {
+      std::printf("PASS\n");
+      return 0;
+    }
+    std::printf("FAIL: %s at tick %ld: %s\n", violation_name[f.v], f.tick,
+                f.what.c_str());
+    return 1;
+  }
+
+  Stats total;
+  std::vector<Failure> failed;
+  std::mutex mtx;
+  std::atomic<long> next(0);
+  std::vector<std::thread> workers;
+  std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+  for (unsigned t = 0; t < threads; ++t) {
+    workers.push_back(std::thread([&]() {
+      Stats local;
+      std::vector<Failure> local_failed;
+      Failure f;
+      for (long i = next++; i < runs; i = next++) {
+        unsigned seed = seed0 + static_cast<unsigned>(i);
+        if (!runStress(seed, cmd_time, stop_time, &map, false, &local,
+                       &f))
+          local_failed.push_back(f);
+      }
+      std::lock_guard<std::mutex> lock(mtx);
+      total.merge(local);
+      failed.insert(failed.end(), local_failed.begin(), local_failed.end());
+    }));
+  }
+  for (size_t t = 0; t < workers.size(); ++t) workers[t].join();
+  double sec = std::chrono::duration<double>(
+                   std::chrono::steady_clock::now() - t0).count();
+  std::cout.rdbuf(cout_buffer);
+
+  printStats(total, sec, threads);
+  if (failed.empty()) {
+    std::printf("PASS\n");
+    return 0;
+  }
+  std::sort(failed.begin(), failed.end(),
+            [](const Failure& a, const Failure& b) { return a.seed < b.seed; });
+  FILE* fp = std::fopen(fail_file.c_str(), "w");
+  if (fp) {
+    for (size_t i = 0; i < failed.size(); ++i) {
+      std::fprintf(fp, "%u %s %ld %s\n", failed[i].seed,
+                   violation_name[failed[i].v], failed[i].tick,
+                   failed[i].what.c_str());
+    }
+    std::fclose(fp);
+  }
+  for (size_t i = 0; i < failed.size() && i < 10; ++i) {
+    std::printf("seed %u: %s at tick %ld: %s\n", failed[i].seed,
+                violation_name[failed[i].v], failed[i].tick,
+                failed[i].what.c_str());
+  }
+  std::printf("FAIL: %zu runs, seeds are saved to %s (replay by --seed)\n",
+              failed.size(), fail_file.c_str());
+  return 1;
+}
@@ -0,0 +1,92 @@
+// Common parts of the cpgen tools (C++11, header only).
+//
+// The tools must walk on the same terrain with the same step adaptation
+// to be compared, so these are kept here once.
+
+#ifndef CPGEN_TOOLS_TOOL_COMMON_H_
+#define CPGEN_TOOLS_TOOL_COMMON_H_
+
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <streambuf>
+#include <vector>
+
+#include "cpgen.h"
+
+namespace cptool {
+
+// sink of std::cout, cpgen reports state changes there
+class NullBuffer : public std::streambuf {
+ protected:
+  int overflow(int c) { return c; }
+};
+
+// @brief parse "--name value" pairs of the command line
+// @param set: bool(const char* name, const char* value), false if unknown
+// @return: false (with a message) if a value is missing or a name is unknown
+template <class Setter>
+bool parseOptions(int argc, char** argv, Setter set) {
+  for (int i = 1; i < argc; i += 2) {
+    if (i + 1 >= argc) {
+      std::fprintf(stderr, "option %s needs a value\n", argv[i]);
+      return false;
+    }
+    if (!set(argv[i], argv[i + 1])) {
+      std::fprintf(stderr, "unknown option %s\n", argv[i]);
+      return false;
+    }
+  }
+  return true;
+}
+
+// @brief step adaptation of the tools (and of the README example)
+inline cp::StepAdaptParam stepAdaptParam() {
+  cp::StepAdaptParam sa = {0.3, 0.8, 0.05, 0.2, 0.15, 1.0, 1.0, 100.0, 10,
+                           0.05, 1.0, 0.02};
+  return sa;
+}
+
+// @brief sole of the tools, used for swing clearance and support polygon
+inline cp::FootGeometry footGeometry() {
+  cp::FootGeometry fg = {0.12, 0.08, 0.05, 0.05};
+  return fg;
+}
+
+// @brief write a random terrain of tiles and blocks around the origin
+// @param path: heightmap file
+inline bool writeTerrain(const char* path) {
+  const double res = 0.05, size = 40.0;
+  cp::HeightMapHeader hdr;
+  std::memcpy(hdr.magic, "CPHM", 4);
+  hdr.cols = hdr.rows = static_cast<uint32_t>(size / res);
+  hdr.reserved = 0;
+  hdr.origin_x = hdr.origin_y = -0.5 * size;
+  hdr.resolution = res;
+  // tiles of 0.5 m from -4 cm to 4 cm, some 0.1 m high blocks on them
+  std::mt19937 rng(12345);
+  const int tile = 10, tiles = hdr.cols / tile;
+  std::vector<float> tile_h(tiles * tiles);
+  for (size_t i = 0; i < tile_h.size(); ++i) {
+    tile_h[i] = 0.02f * (static_cast<int>(rng() % 5) - 2);
+    if (rng() % 20 == 0) tile_h[i] += 0.1f;
+  }
+  std::vector<float> h(static_cast<size_t>(hdr.cols) * hdr.rows);
+  for (uint32_t r = 0; r < hdr.rows; ++r) {
+    for (uint32_t c = 0; c < hdr.cols; ++c) {
+      h[r * hdr.cols + c] = tile_h[(r / tile) * tiles + c / tile];
+    }
+  }
+  return cp::HeightMap::write(path, hdr, &h[0]);
+}
+
+// @brief height of terrain, 0 out of the map or without a map
+inline double groundHeight(const cp::HeightMap* map, double x, double y) {
+  double h = 0.0;
+  if (map && !map->getHeight(x, y, &h)) h = 0.0;
+  return h;
+}
+
+}  // namespace cptool
+
+#endif  // CPGEN_TOOLS_TOOL_COMMON_H_
@@ -0,0 +1,94 @@
+#ifndef CPGEN_TRAJECTORY_H_
+#define CPGEN_TRAJECTORY_H_
+
+#include <vector>
+
+#include "eigen_types.h"
+
+namespace cp {
+
+// Offline walking pattern buffer.
+// Each channel is stored as a separate array (structure of arrays)
+// so that batched calculations can run over contiguous memory.
+struct Trajectory {
+  std::vector<double> com[3];         // x, y, z
+  std::vector<double> waist_q[4];     // w, x, y, z
+  std::vector<double> leg_p[2][3];    // [right, left][x, y, z]
+  std::vector<double> leg_q[2][4];    // [right, left][w, x, y, z]
+  std::vector<double> zmp[2];         // reference ZMP x, y
+  std::vector<double> cp[2];          // reference CP x, y
+  std::vector<int> support;           // support leg (rl)
+
+  size_t size() const { return com[0].size(); }
+  void clear() { resize(0); }
+  void reserve(size_t n) {
+    for (int i = 0; i < 3; ++i) com[i].reserve(n);
+    for (int i = 0; i < 4; ++i) waist_q[i].reserve(n);
+    for (int lr = 0; lr < 2; ++lr) {
+      for (int i = 0; i < 3; ++i) leg_p[lr][i].reserve(n);
+      for (int i = 0; i < 4; ++i) leg_q[lr][i].reserve(n);
+    }
+    for (int i = 0; i < 2; ++i) {
+      zmp[i].reserve(n);
+      cp[i].reserve(n);
+    }
+    support.reserve(n);
+  }
+  void resize(size_t n) {
+    for (int i = 0; i < 3; ++i) com[i].resize(n);
+    for (int i = 0; i < 4; ++i) waist_q[i].resize(n);
+    for (int lr = 0; lr < 2; ++lr) {
+      for (int i = 0; i < 3; ++i) leg_p[lr][i].resize(n);
+      for (int i = 0; i < 4; ++i) leg_q[lr][i].resize(n);
+    }
+    for (int i = 0; i < 2; ++i) {
+      zmp[i].resize(n);
+      cp[i].resize(n);
+    }
+    support.resize(n);
+  }
+
+  void push_back(const Vector3& com_pos, const Quat& waist_r,
+                 const Pose leg_pose[], const Vector2& ref_zmp,
+                 const Vector2& ref_cp, rl support_leg) {
+    for (int i = 0; i < 3; ++i) com[i].push_back(com_pos[i]);
+    waist_q[0].push_back(waist_r.w());
+    for (int i = 0; i < 3; ++i) waist_q[i + 1].push_back(waist_r.vec()[i]);
+    for (int lr = 0; lr < 2; ++lr) {
+      for (int i = 0; i < 3; ++i) leg_p[lr][i].push_back(leg_pose[lr].p()[i]);
+      leg_q[lr][0].push_back(leg_pose[lr].q().w());
+      for (int i = 0; i < 3; ++i)
+        leg_q[lr][i + 1].push_back(leg_pose[lr].q().vec()[i]);
+    }
+    for (int i = 0; i < 2; ++i) {
+      zmp[i].push_back(ref_zmp[i]);
+      cp[i].push_back(ref_cp[i]);
+    }
+    support.push_back(support_leg);
+  }
+  // without ZMP and CP (static: both are under the CoM, double support)
+  void push_back(const Vector3& com_pos, const Quat& waist_r,
+                 const Pose leg_pose[]) {
+    Vector2 c(com_pos.x(), com_pos.y());
+    push_back(com_pos, waist_r, leg_pose, c, c, both);
+  }
+  void push_back(const WalkingPattern& wp) {
+    push_back(wp.com_pos, wp.waist_r, wp.leg_pose, wp.ref_zmp, wp.ref_cp,
+              wp.support);
+  }
+};
+
+// Offline joint angle buffer of both legs (structure of arrays)
+struct JointTrajectory {
+  std::vector<double> q[2][6];  // [right, left][joint]
+
+  size_t size() const { return q[0][0].size(); }
+  void resize(size_t n) {
+    for (int lr = 0; lr < 2; ++lr)
+      for (int j = 0; j < 6; ++j) q[lr][j].resize(n);
+  }
+};
+
+}  // namespace cp
+
+#endif  // CPGEN_TRAJECTORY_H_